@@ -0,0 +1,54 @@
+#!/bin/bash
+# Compara MPI puro, hilos puros e hibrido con el mismo numero de nucleos:
+# para cada divisor t de N lanza N/t procesos de mpi_filterer con t hilos
+# cada uno, y ademas filtro_pth con N hilos. Muestra el mejor de 3.
+#
+# Uso: scripts/bench_layouts.sh <imagen> <nucleos> [opciones de filtro]
+#   scripts/bench_layouts.sh big.pgm 8 --f gaussian --radius 5
+#
+# Variables: MPI_FILTERER (./mpi_filterer), FILTRO_PTH (./filtro_pth),
+# MPIRUN (mpirun), MPI_FLAGS (por ejemplo "--host master,node1,node2").
+
+if [ $# -lt 2 ]; then
+    echo "Uso: $0 <imagen> <nucleos> [opciones de filtro]"
+    exit 1
+fi
+image=$1
+cores=$2
+shift 2
+filter=("$@")
+[ ${#filter[@]} -eq 0 ] && filter=(--f blur)
+
+MPI_FILTERER=${MPI_FILTERER:-./mpi_filterer}
+FILTRO_PTH=${FILTRO_PTH:-./filtro_pth}
+MPIRUN=${MPIRUN:-mpirun}
+out=$(mktemp -d)
+trap 'rm -rf "$out"' EXIT
+
+# Mejor de 3 del tiempo que imprime el programa en la linea de $pattern
+# ("...: <tiempo> s" o "...: <tiempo> segundos").
+best() {
+    local best=""
+    for rep in 1 2 3; do
+        local t
+        t=$("$@" 2>/dev/null | grep -E "$pattern" | grep -oE ': [0-9.e+-]+ (s|segundos)' | head -1 | cut -d' ' -f2)
+        [ -z "$t" ] && { echo "error"; return; }
+        if [ -z "$best" ] || awk "BEGIN{exit !($t < $best)}"; then best=$t; fi
+    done
+    echo "$best"
+}
+
+printf "%-10s %8s %6s %12s\n" "modo" "procesos" "hilos" "tiempo (s)"
+pattern="^Tiempo total"
+for ((threads = 1; threads <= cores; threads++)); do
+    ((cores % threads == 0)) || continue
+    ranks=$((cores / threads))
+    if ((threads == 1)); then mode="MPI"; elif ((ranks == 1)); then mode="hilos"; else mode="hibrido"; fi
+    t=$(best $MPIRUN $MPI_FLAGS -np $ranks "$MPI_FILTERER" "$image" "$out/o" "${filter[@]}" --threads $threads)
+    printf "%-10s %8d %6d %12s\n" "$mode" $ranks $threads "$t"
+done
+
+# filtro_pth solo toma --f/--kernel y sus opciones; escribe una imagen.
+pattern="^Tiempo real"
+t=$(best "$FILTRO_PTH" "$image" "$out/o.pnm" "${filter[@]}" --threads $cores)
+printf "%-10s %8d %6d %12s\n" "pthreads" 1 $cores "$t"
@@ -0,0 +1,37 @@
+#!/bin/bash
+# Comprueba que mpi_filterer --dynamic da la misma imagen que un solo
+# proceso, con --border wrap y bloques cuyo ultimo trozo tiene menos de r
+# filas (fruit.pgm: 450 filas, con 5 procesos bloques de 16 y el ultimo de
+# 2). Termina con error si alguna salida difiere.
+#
+# Uso: scripts/check_mpi_dynamic.sh [imagen]
+#
+# Variables: MPI_FILTERER (./mpi_filterer), MPIRUN (mpirun), MPI_FLAGS.
+
+image=${1:-Images/fruit.pgm}
+MPI_FILTERER=${MPI_FILTERER:-./mpi_filterer}
+MPIRUN=${MPIRUN:-mpirun}
+out=$(mktemp -d)
+trap 'rm -rf "$out"' EXIT
+
+failures=0
+for filter in "--f blur --radius 3" "--f gaussian --radius 4" "--f sharpen"; do
+    for border in wrap mirror; do
+        args=($filter --border $border)
+        name=${args[1]}
+        if ! $MPIRUN $MPI_FLAGS -np 1 "$MPI_FILTERER" "$image" "$out/ref" "${args[@]}" >/dev/null; then
+            echo "error: $MPI_FILTERER fallo con ${args[*]}"
+            exit 1
+        fi
+        for np in 2 3 5; do
+            $MPIRUN $MPI_FLAGS -np $np "$MPI_FILTERER" "$image" "$out/dyn" "${args[@]}" --dynamic >/dev/null
+            if cmp -s "$out"/ref_"$name".* "$out"/dyn_"$name".*; then
+                echo "ok       -np $np --dynamic ${args[*]}"
+            else
+                echo "DISTINTA -np $np --dynamic ${args[*]}"
+                failures=$((failures + 1))
+            fi
+        done
+    done
+done
+[ $failures -eq 0 ]
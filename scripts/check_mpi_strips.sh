@@ -0,0 +1,45 @@
+#!/bin/bash
+# Comprueba que mpi_filterer da la misma imagen con 2 y 3 procesos que con
+# uno cuando las bandas van alineadas a bloques FFT y la ultima se quedaria
+# con menos de r filas (1000x967: con 2 procesos el corte cae en la fila
+# 964 y sobran 3). Prueba el camino --root-io con P5 y el de por defecto con
+# P2. Termina con error si alguna salida difiere.
+#
+# Uso: scripts/check_mpi_strips.sh
+#
+# Variables: MPI_FILTERER (./mpi_filterer), MPIRUN (mpirun), MPI_FLAGS.
+
+MPI_FILTERER=${MPI_FILTERER:-./mpi_filterer}
+MPIRUN=${MPIRUN:-mpirun}
+out=$(mktemp -d)
+trap 'rm -rf "$out"' EXIT
+
+width=1000
+height=967
+{ printf 'P5\n%d %d\n255\n' $width $height; head -c $((width * height)) /dev/urandom; } > "$out/big.pgm"
+{ printf 'P2\n%d %d\n255\n' $width $height; od -An -v -tu1 -w$width "$out/big.pgm" -j $(($(stat -c %s "$out/big.pgm") - width * height)); } > "$out/big_ascii.pgm"
+
+failures=0
+for image in big.pgm big_ascii.pgm; do
+    io=()
+    [ $image = big.pgm ] && io=(--root-io)
+    for filter in "--f gaussian --radius 15" "--f blur --radius 4"; do
+        args=($filter --algo fft "${io[@]}")
+        name=${args[1]}
+        if ! $MPIRUN $MPI_FLAGS -np 1 "$MPI_FILTERER" "$out/$image" "$out/ref" "${args[@]}" >/dev/null; then
+            echo "error: $MPI_FILTERER fallo con $image ${args[*]}"
+            exit 1
+        fi
+        for np in 2 3; do
+            rm -f "$out"/strips_"$name".*
+            if $MPIRUN $MPI_FLAGS -np $np "$MPI_FILTERER" "$out/$image" "$out/strips" "${args[@]}" >/dev/null 2>&1 &&
+               cmp -s "$out"/ref_"$name".* "$out"/strips_"$name".*; then
+                echo "ok       -np $np $image ${args[*]}"
+            else
+                echo "DISTINTA -np $np $image ${args[*]}"
+                failures=$((failures + 1))
+            fi
+        done
+    done
+done
+[ $failures -eq 0 ]
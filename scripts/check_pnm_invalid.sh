@@ -0,0 +1,27 @@
+#!/bin/bash
+# Comprueba que filtro rechaza (codigo de salida distinto de 0, sin dejar
+# salida) cada imagen de Images/invalid, con la lectura entera y con
+# --stream. Termina con error si alguna se acepta.
+#
+# Uso: scripts/check_pnm_invalid.sh [directorio]
+#
+# Variables: FILTRO (./filtro).
+
+dir=${1:-Images/invalid}
+FILTRO=${FILTRO:-./filtro}
+out=$(mktemp -d)
+trap 'rm -rf "$out"' EXIT
+
+failures=0
+for image in "$dir"/*.p?m; do
+    for mode in "" --stream; do
+        if "$FILTRO" "$image" "$out/salida.pgm" --f blur $mode >/dev/null 2>&1 || [ -e "$out/salida.pgm" ]; then
+            echo "ACEPTADA $image $mode"
+            failures=$((failures + 1))
+            rm -f "$out/salida.pgm"
+        else
+            echo "ok       $image $mode"
+        fi
+    done
+done
+[ $failures -eq 0 ]
@@ -2,107 +2,54 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <cstdint>
+#include "pnmfilter.h"
 using namespace std;
 
-class PNMImage {
-private:
-    char magic[3];   
-    int width;
-    int height;
-    int max_color;
-    int* pixels;
-    int pixel_count;
+template <typename T>
+int copyImage(const char* input, const char* output, int binary) {
+    PNMImage<T> img;
 
-public:
-    // Constructor
-    PNMImage() : width(0), height(0), max_color(0), pixels(nullptr), pixel_count(0) {
-        magic[0] = '\0';
-    }
-
-    // Destructor
-    ~PNMImage() {
-        if (pixels) free(pixels);
-    }
-
-    bool load(const char* filename) {
-        FILE* file = fopen(filename, "r");
-        if (!file) {
-            cerr << "Error: no se pudo abrir " << filename << endl;
-            return false;
-        }
+    if (!img.load(input)) return 1;
+    pnm_report_read(img.getReadStats());
 
-        if (fscanf(file, "%2s", magic) != 1) {
-            cerr << "Error leyendo magic number" << endl;
-            fclose(file);
-            return false;
-        }
+    if (binary >= 0) img.setBinary(binary != 0);
 
-        if (fscanf(file, "%d %d", &width, &height) != 2) {
-            cerr << "Error leyendo width/height" << endl;
-            fclose(file);
-            return false;
-        }
+    if (!img.save(output)) return 1;
 
-        if (fscanf(file, "%d", &max_color) != 1) {
-            cerr << "Error leyendo max_color" << endl;
-            fclose(file);
-            return false;
-        }
-
-        pixel_count = width * height;
-        if (strcmp(magic, "P3") == 0) pixel_count *= 3;
-
-        pixels = (int*) malloc(pixel_count * sizeof(int));
-        if (!pixels) {
-            cerr << "Error reservando memoria" << endl;
-            fclose(file);
-            return false;
-        }
-
-        for (int i = 0; i < pixel_count; i++) {
-            if (fscanf(file, "%d", &pixels[i]) != 1) {
-                cerr << "Error leyendo pixeles" << endl;
-                free(pixels);
-                pixels = nullptr;
-                fclose(file);
-                return false;
-            }
-        }
-
-        fclose(file);
-        return true;
-    }
-
-    bool save(const char* filename) const {
-        FILE* out = fopen(filename, "w");
-        if (!out) {
-            cerr << "Error: no se pudo abrir " << filename << " para escritura" << endl;
-            return false;
-        }
-
-        fprintf(out, "%s\n%d %d\n%d\n", magic, width, height, max_color);
-
-        for (int i = 0; i < pixel_count; i++) {
-            fprintf(out, "%d ", pixels[i]);
-            if ((i+1) % 12 == 0) fprintf(out, "\n");
-        }
-
-        fclose(out);
-        return true;
-    }
-};
+    cout << "Imagen copiada exitosamente.\n";
+    return 0;
+}
 
 int main(int argc, char* argv[]) {
     if (argc < 3) {
-        cout << "Uso: " << argv[0] << " input_image output_image" << endl;
+        cout << "Uso: " << argv[0] << " input_image output_image [--binary|--ascii] [--profile] [--profile-json fichero]" << endl;
         return 1;
     }
 
-    PNMImage img;
+    // -1: el formato de la entrada.
+    int binary = -1;
+    const char* profile_json = nullptr;
+    bool profile = false;
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "--binary") == 0) binary = 1;
+        else if (strcmp(argv[i], "--ascii") == 0) binary = 0;
+        else if (strcmp(argv[i], "--profile") == 0) profile = true;
+        else if (strcmp(argv[i], "--profile-json") == 0 && i + 1 < argc) {
+            profile = true;
+            profile_json = argv[++i];
+        } else {
+            cerr << "Opcion no reconocida: " << argv[i] << endl;
+            return 1;
+        }
+    }
+    if (profile) profiler().enable();
 
-    if (!img.load(argv[1])) return 1;
-    if (!img.save(argv[2])) return 1;
+    PNMHeader header;
+    if (!pnm_peek_header(argv[1], header)) return 1;
 
-    cout << "Imagen copiada exitosamente.\n";
-    return 0;
+    int status = (header.max_color > 255) ? copyImage<uint16_t>(argv[1], argv[2], binary)
+                                          : copyImage<uint8_t>(argv[1], argv[2], binary);
+    profile_finish(argv[0], profile_json);
+    return status;
 }
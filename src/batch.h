@@ -0,0 +1,324 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+#include "pnm_image.h"
+#include "convolve.h"
+#include "options.h"
+#include "thread_pool.h"
+#include "tile_filter.h"
+
+// Modo lote (--input-dir/--output-dir, --glob o --list): muchas imagenes en
+// un solo proceso, en un pipeline de tres etapas que se solapan:
+//
+//   lectores (--readers) -> calculo (ThreadPool) -> escritores (--writers)
+//
+// Un lector reserva la memoria de la imagen del presupuesto (--memory-mb)
+// antes de cargarla y el escritor la devuelve al guardarla, asi que si el
+// calculo o el disco de salida van lentos los lectores se paran
+// (contrapresion) en vez de llenar la memoria. Cada imagen se filtra en sitio
+// con filter_in_place, repartida en bloques entre los hilos del pool.
+
+
+// Lista de entrada: las lineas de --list (relativas a --input-dir si no son
+// absolutas) o los archivos de --input-dir que cumplen --glob, ordenados.
+inline bool batch_inputs(const FilterOptions& opt, std::vector<std::string>& files) {
+    std::string dir = opt.input_dir ? opt.input_dir : "";
+    if (opt.list_file) {
+        std::ifstream list(opt.list_file);
+        if (!list) {
+            std::cerr << "Error: no se pudo abrir la lista " << opt.list_file << std::endl;
+            return false;
+        }
+        std::string line;
+        while (std::getline(list, line)) {
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            if (line.empty() || line[0] == '#') continue;
+            files.push_back((dir.empty() || line[0] == '/') ? line : dir + "/" + line);
+        }
+        return true;
+    }
+
+    DIR* d = opendir(dir.c_str());
+    if (!d) {
+        std::cerr << "Error: no se pudo abrir el directorio " << dir << std::endl;
+        return false;
+    }
+    const char* pattern = opt.glob ? opt.glob : "*.p[gpn]m";
+    while (dirent* entry = readdir(d)) {
+        if (entry->d_name[0] == '.') continue;
+        if (fnmatch(pattern, entry->d_name, 0) == 0) files.push_back(dir + "/" + entry->d_name);
+    }
+    closedir(d);
+    std::sort(files.begin(), files.end());
+    return true;
+}
+
+inline std::string batch_output_name(const FilterOptions& opt, const std::string& input) {
+    size_t slash = input.find_last_of('/');
+    return std::string(opt.output_dir) + "/" + input.substr(slash == std::string::npos ? 0 : slash + 1);
+}
+
+
+// Presupuesto de memoria compartido por las imagenes en vuelo. Una imagen
+// mayor que todo el presupuesto pasa cuando no hay ninguna otra.
+class MemoryBudget {
+private:
+    std::mutex mutex;
+    std::condition_variable freed;
+    size_t limit, used, peak;
+
+public:
+    explicit MemoryBudget(size_t limit_) : limit(limit_), used(0), peak(0) {}
+
+    void acquire(size_t bytes) {
+        std::unique_lock<std::mutex> lock(mutex);
+        freed.wait(lock, [&] { return used == 0 || used + bytes <= limit; });
+        used += bytes;
+        peak = std::max(peak, used);
+    }
+
+    void release(size_t bytes) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            used -= bytes;
+        }
+        freed.notify_all();
+    }
+
+    size_t peakBytes() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return peak;
+    }
+};
+
+
+// Una imagen del lote. La clase base oculta el tipo de muestra para que las
+// colas del pipeline no dependan de el.
+class BatchJob {
+public:
+    std::string input, output;
+    size_t bytes;      // memoria reservada del presupuesto
+
+    BatchJob(const std::string& input_, const std::string& output_, size_t bytes_)
+        : input(input_), output(output_), bytes(bytes_) {}
+    virtual ~BatchJob() {}
+
+    virtual bool load() = 0;
+    virtual bool filter(ThreadPool& pool, const Kernel& kernel, const FilterOptions& opt) = 0;
+    virtual bool save() = 0;
+};
+
+template <typename T>
+class BatchImage : public BatchJob {
+private:
+    PNMImage<T> img;
+
+public:
+    using BatchJob::BatchJob;
+
+    bool load() { return img.load(input.c_str()); }
+
+    bool filter(ThreadPool& pool, const Kernel& kernel, const FilterOptions& opt) {
+        ConvPlan<T> plan(kernel, img.getWidth(), img.getHeight(), img.getChannels(),
+                         img.getMaxColor(), opt.convOptions());
+        return filter_in_place(pool, plan, img.getPixels(), img.getWidth(), img.getHeight(),
+                               img.getChannels(), kernel.radius(), opt.border);
+    }
+
+    bool save() { return img.save(output.c_str()); }
+};
+
+
+// Cola de trabajos terminados hacia los escritores. No necesita limite: el
+// presupuesto de memoria ya acota cuantos trabajos hay en vuelo.
+class JobQueue {
+private:
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<std::unique_ptr<BatchJob>> jobs;
+    bool closed;
+
+public:
+    JobQueue() : closed(false) {}
+
+    void push(std::unique_ptr<BatchJob> job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        ready.notify_one();
+    }
+
+    // Devuelve nullptr cuando la cola esta cerrada y vacia.
+    std::unique_ptr<BatchJob> pop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        ready.wait(lock, [this] { return closed || !jobs.empty(); });
+        if (jobs.empty()) return nullptr;
+        std::unique_ptr<BatchJob> job = std::move(jobs.front());
+        jobs.pop_front();
+        return job;
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        ready.notify_all();
+    }
+};
+
+
+// Ejecuta el lote con compute_threads hilos de calculo. Devuelve 0 si todas
+// las imagenes se procesaron.
+inline int run_batch(const FilterOptions& opt, int compute_threads) {
+    std::vector<std::string> files;
+    if (!batch_inputs(opt, files)) return 1;
+    if (files.empty()) {
+        std::cerr << "Error: no hay imagenes que procesar" << std::endl;
+        return 1;
+    }
+
+    Kernel kernel;
+    if (!load_filter_kernel(opt.filter, opt, kernel)) return 1;
+
+    auto start = std::chrono::steady_clock::now();
+    ThreadPool pool(compute_threads);
+    MemoryBudget budget((size_t) opt.memory_mb << 20);
+    JobQueue written;
+    std::atomic<size_t> next(0);
+    std::atomic<int> failures(0);
+    std::atomic<double> read_time(0.0), write_time(0.0);
+    std::atomic<size_t> total_bytes(0);
+    TaskGroup group(pool);
+
+    auto add = [](std::atomic<double>& total, double seconds) {
+        double old = total.load();
+        while (!total.compare_exchange_weak(old, old + seconds)) {}
+    };
+    auto seconds_since = [](std::chrono::steady_clock::time_point t0) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    };
+
+    auto reader = [&]() {
+        for (size_t i; (i = next.fetch_add(1)) < files.size(); ) {
+            PNMHeader header;
+            if (!pnm_peek_header(files[i].c_str(), header)) {
+                failures++;
+                continue;
+            }
+            size_t samples = (size_t) header.width * header.height * header.channels;
+            std::unique_ptr<BatchJob> job;
+            std::string output = batch_output_name(opt, files[i]);
+            if (header.max_color > 255) job.reset(new BatchImage<uint16_t>(files[i], output, samples * 2));
+            else job.reset(new BatchImage<uint8_t>(files[i], output, samples));
+
+            budget.acquire(job->bytes);
+            auto t0 = std::chrono::steady_clock::now();
+            if (!job->load()) {
+                budget.release(job->bytes);
+                failures++;
+                continue;
+            }
+            add(read_time, seconds_since(t0));
+            total_bytes += job->bytes;
+
+            // El filtrado de la imagen es una tarea del pool; sus bloques
+            // son tareas anidadas que pueden robar los demas hilos.
+            BatchJob* raw = job.release();
+            group.run([&, raw]() {
+                std::unique_ptr<BatchJob> job(raw);
+                if (!job->filter(pool, kernel, opt)) {
+                    std::cerr << "Error filtrando " << job->input << std::endl;
+                    budget.release(job->bytes);
+                    failures++;
+                    return;
+                }
+                written.push(std::move(job));
+            });
+        }
+    };
+
+    auto writer = [&]() {
+        while (std::unique_ptr<BatchJob> job = written.pop()) {
+            auto t0 = std::chrono::steady_clock::now();
+            bool ok = job->save();
+            add(write_time, seconds_since(t0));
+            budget.release(job->bytes);
+            if (!ok) failures++;
+        }
+    };
+
+    std::vector<std::thread> readers, writers;
+    for (int i = 0; i < opt.writers; i++) writers.push_back(std::thread(writer));
+    for (int i = 0; i < opt.readers; i++) readers.push_back(std::thread(reader));
+    for (std::thread& t : readers) t.join();
+    group.wait();
+    written.close();
+    for (std::thread& t : writers) t.join();
+
+    double elapsed = seconds_since(start);
+    size_t done = files.size() - failures.load();
+    std::cout << "Lote: " << done << " de " << files.size() << " imagenes en " << elapsed << " s ("
+              << done / elapsed << " imagenes/s, " << total_bytes.load() / 1e6 / elapsed << " MB/s)" << std::endl;
+    // Tiempos sumados por etapa; el de filtrado es el tiempo ocupado de los
+    // hilos del pool.
+    std::cout << "Lectura " << read_time.load() << " s, filtrado " << pool.busyTime() << " s, escritura "
+              << write_time.load() << " s (sumados por etapa); memoria maxima en vuelo "
+              << budget.peakBytes() / 1e6 << " MB" << std::endl;
+    std::cout << opt.readers << " lectores, " << pool.size() << " hilos de calculo, " << opt.writers
+              << " escritores" << std::endl;
+    return failures.load() == 0 ? 0 : 1;
+}
+
+
+// Punto de entrada de --input-dir/--list en los front ends: las banderas
+// empiezan en argv[1]. threaded: filtro_pth y filtro_omp, con los hilos de
+// --threads o, sin --threads, default_threads (0: uno por nucleo); si no,
+// un solo hilo de calculo.
+inline int batch_main(int argc, char* argv[], bool threaded, int default_threads = 0) {
+    FilterOptions opt;
+    if (!parse_filter_options(argc, argv, 1, opt)) return 1;
+    // Opciones de filtro_omp que el lote no usa: mejor un error que
+    // ignorarlas.
+    const char* unused = opt.chain ? "--chain" : opt.schedule ? "--schedule" : opt.pin ? "--pin"
+                         : opt.scaling ? "--scaling" : nullptr;
+    if (unused) {
+        std::cerr << "Error: " << unused << " no se admite en el modo lote" << std::endl;
+        return 1;
+    }
+    if (opt.profile) profiler().enable();
+    if ((!opt.input_dir && !opt.list_file) || !opt.output_dir || (!opt.filter && !opt.kernel_file)) {
+        std::cerr << "Error: el modo lote necesita --input-dir o --list, --output-dir y --f o --kernel" << std::endl;
+        return 1;
+    }
+    if (mkdir(opt.output_dir, 0755) != 0 && errno != EEXIST) {
+        std::cerr << "Error: no se pudo crear " << opt.output_dir << std::endl;
+        return 1;
+    }
+    int threads = 1;
+    if (threaded) threads = (opt.threads > 0) ? opt.threads : default_threads;
+    int status = run_batch(opt, threads);
+    profile_finish(argv[0], opt.profile_json);
+    return status;
+}
+
+#endif
@@ -0,0 +1,60 @@
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <vector>
+#include "options.h"
+using namespace std;
+
+// Mide directo, separable y FFT para kernels de 3x3 a 31x31 sobre una
+// imagen gris aleatoria de 8 bits. Sirve para fijar FFT_MIN_KERNEL_SIZE.
+
+static double timePlan(const Kernel& kernel, int algorithm, const vector<uint8_t>& src, vector<uint8_t>& dst,
+                       int width, int height, ConvAlgorithm& used) {
+    ConvOptions opt;
+    opt.algorithm = algorithm;
+    double best = 0.0;
+    for (int rep = 0; rep < 3; rep++) {
+        auto start = chrono::steady_clock::now();
+        ConvPlan<uint8_t> plan(kernel, width, height, 1, 255, opt);
+        plan.run(src.data(), 0, width, 0, height, dst.data(), (size_t) width);
+        double t = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (rep == 0 || t < best) best = t;
+        used = plan.algorithm();
+    }
+    return best;
+}
+
+int main(int argc, char* argv[]) {
+    int width = 1024, height = 1024;
+    if (argc == 3) {
+        if (!parse_int_option("ancho", argv[1], 16, 16384, width)) return 1;
+        if (!parse_int_option("alto", argv[2], 16, 16384, height)) return 1;
+    } else if (argc != 1) {
+        cout << "Uso: " << argv[0] << " [ancho alto]\n";
+        return 1;
+    }
+
+    vector<uint8_t> src((size_t) width * height), dst(src.size());
+    srand(1);
+    for (uint8_t& p : src) p = (uint8_t) (rand() & 255);
+
+    printf("Imagen %dx%d, tiempos en ms (mejor de 3)\n", width, height);
+    printf("%5s %10s %10s %10s %10s\n", "K", "directo", "separable", "fft", "auto");
+    for (int size = 3; size <= MAX_KERNEL_SIZE; size += 2) {
+        // Gaussiana (separable) y la misma con un tap alterado (no separable).
+        Kernel kernel = gaussian_kernel(size / 2);
+        Kernel general = kernel;
+        general.taps[0] += 0.01f;
+
+        ConvAlgorithm used, auto_used;
+        double direct = timePlan(general, CONV_DIRECT, src, dst, width, height, used);
+        double separable = timePlan(kernel, CONV_SEPARABLE, src, dst, width, height, used);
+        double fft = timePlan(general, CONV_FFT, src, dst, width, height, used);
+        double automatic = timePlan(general, -1, src, dst, width, height, auto_used);
+        printf("%5d %10.2f %10.2f %10.2f %10.2f (%s)\n", size, direct * 1e3, separable * 1e3, fft * 1e3,
+               automatic * 1e3, conv_algorithm_name(auto_used));
+    }
+    return 0;
+}
@@ -0,0 +1,346 @@
+#ifdef PNMFILTER_WITH_MPI
+#include <mpi.h>
+#endif
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+#include "pnmfilter.h"
+#include "options.h"
+#include "batch.h"
+using namespace std;
+
+// Compara los backends de libpnmfilter sobre las mismas imagenes: por cada
+// imagen, backend y numero de hilos hace --warmup pasadas sin medir y
+// --reps medidas con steady_clock (tiempo real, no el de CPU de clock()).
+// Informa mediana y p95, Mpixel/s y speedup y eficiencia frente al serial
+// de la misma imagen, y comprueba que la salida es igual a la del serial.
+//
+// Con mpirun -np N (N > 1) solo se mide el backend mpi (y el serial en rank
+// 0 como referencia); el resto de rangos solo entra en las pasadas MPI.
+
+
+struct BenchResult {
+    string image;
+    int width, height, channels;
+    FilterBackend backend;
+    int ranks, threads, reps;
+    double median, p95, best;
+    double mpixels, speedup, efficiency;
+    bool identical;
+};
+
+struct BenchConfig {
+    vector<string> images;
+    vector<FilterBackend> backends;
+    vector<int> threads;
+    int warmup, reps;
+    const char* json;
+    const char* csv;
+
+    BenchConfig() : warmup(1), reps(10), json(nullptr), csv(nullptr) {}
+};
+
+
+static vector<string> split_list(const char* text) {
+    vector<string> items;
+    string current;
+    for (const char* p = text; ; p++) {
+        if (*p == ',' || *p == '\0') {
+            if (!current.empty()) items.push_back(current);
+            current.clear();
+            if (*p == '\0') break;
+        } else {
+            current += *p;
+        }
+    }
+    return items;
+}
+
+// Percentil p (0..1) por el metodo del rango mas cercano.
+static double percentile(vector<double> times, double p) {
+    sort(times.begin(), times.end());
+    size_t index = (size_t) ceil(p * times.size());
+    return times[min(times.size(), max(index, (size_t) 1)) - 1];
+}
+
+static int world_rank(int& world) {
+    int rank = 0;
+    world = 1;
+#ifdef PNMFILTER_WITH_MPI
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &world);
+#endif
+    return rank;
+}
+
+
+// Tiempos de las pasadas medidas. Con MPI cada pasada empieza tras una
+// barrera y cuenta el rango mas lento.
+template <typename T>
+static bool time_backend(const ConvPlan<T>& plan, const T* src, T* dst, int width, int height, int channels,
+                         FilterBackend backend, int threads, const BenchConfig& cfg, vector<double>& times) {
+    times.clear();
+    for (int i = 0; i < cfg.warmup + cfg.reps; i++) {
+#ifdef PNMFILTER_WITH_MPI
+        if (backend == BACKEND_MPI) MPI_Barrier(MPI_COMM_WORLD);
+#endif
+        auto start = chrono::steady_clock::now();
+        if (!filter_pixels(plan, src, dst, width, height, channels, backend, threads)) return false;
+        double t = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+#ifdef PNMFILTER_WITH_MPI
+        if (backend == BACKEND_MPI) MPI_Allreduce(MPI_IN_PLACE, &t, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+#endif
+        if (i >= cfg.warmup) times.push_back(t);
+    }
+    return true;
+}
+
+
+template <typename T>
+static bool bench_image(const string& path, const Kernel& kernel, const FilterOptions& opt,
+                        const BenchConfig& cfg, vector<BenchResult>& results) {
+    int world;
+    const int rank = world_rank(world);
+
+    PNMImage<T> img;
+    if (!img.load(path.c_str())) return false;
+    const int width = img.getWidth(), height = img.getHeight(), channels = img.getChannels();
+    ConvPlan<T> plan(kernel, width, height, channels, img.getMaxColor(), opt.convOptions());
+    vector<T> reference((size_t) img.getPixelCount()), dst(reference.size());
+
+    BenchResult r;
+    r.image = path;
+    r.width = width;
+    r.height = height;
+    r.channels = channels;
+
+    // Referencia serial: solo rank 0.
+    vector<double> serial_times, times;
+    if (rank == 0 && !time_backend(plan, img.getPixels(), reference.data(), width, height, channels,
+                                   BACKEND_SERIAL, 1, cfg, serial_times)) {
+        return false;
+    }
+
+    for (FilterBackend backend : cfg.backends) {
+        if (world > 1 && backend != BACKEND_MPI) continue;
+        for (int threads : cfg.threads) {
+            if (backend == BACKEND_SERIAL) {
+                if (threads != cfg.threads.front()) continue;
+                threads = 1;
+                times = serial_times;
+                dst = reference;
+            } else if (!time_backend(plan, img.getPixels(), dst.data(), width, height, channels, backend,
+                                     threads, cfg, times)) {
+                return false;
+            }
+            if (rank != 0) continue;
+
+            r.backend = backend;
+            r.ranks = (backend == BACKEND_MPI) ? world : 1;
+            r.threads = threads;
+            r.reps = (int) times.size();
+            r.median = percentile(times, 0.5);
+            r.p95 = percentile(times, 0.95);
+            r.best = *min_element(times.begin(), times.end());
+            r.mpixels = (double) width * height / r.median / 1e6;
+            r.speedup = percentile(serial_times, 0.5) / r.median;
+            r.efficiency = r.speedup / (r.ranks * r.threads);
+            r.identical = (dst == reference);
+            results.push_back(r);
+
+            size_t slash = path.find_last_of('/');
+            printf("%-14s %-8s %4d %5d %10.3f %10.3f %9.1f %8.2f %8.2f%s\n",
+                   path.substr(slash == string::npos ? 0 : slash + 1).c_str(),
+                   backend_name(backend), r.ranks, r.threads, r.median * 1e3, r.p95 * 1e3, r.mpixels,
+                   r.speedup, r.efficiency, r.identical ? "" : " DISTINTA");
+            fflush(stdout);
+        }
+    }
+    return true;
+}
+
+
+static bool write_json(const char* filename, const char* filter, const BenchConfig& cfg,
+                       const vector<BenchResult>& results) {
+    FILE* f = fopen(filename, "w");
+    if (!f) {
+        cerr << "Error: no se pudo abrir " << filename << " para escritura" << endl;
+        return false;
+    }
+    fprintf(f, "{\n  \"filter\": \"%s\",\n  \"warmup\": %d,\n  \"reps\": %d,\n  \"hardware_threads\": %u,\n",
+            filter, cfg.warmup, cfg.reps, thread::hardware_concurrency());
+    fprintf(f, "  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        fprintf(f, "    {\"image\": \"%s\", \"width\": %d, \"height\": %d, \"channels\": %d, "
+                   "\"backend\": \"%s\", \"ranks\": %d, \"threads\": %d, \"reps\": %d, "
+                   "\"median_s\": %.9f, \"p95_s\": %.9f, \"min_s\": %.9f, \"mpixel_s\": %.3f, "
+                   "\"speedup\": %.4f, \"efficiency\": %.4f, \"identical\": %s}%s\n",
+                r.image.c_str(), r.width, r.height, r.channels, backend_name(r.backend), r.ranks, r.threads,
+                r.reps, r.median, r.p95, r.best, r.mpixels, r.speedup, r.efficiency,
+                r.identical ? "true" : "false", (i + 1 < results.size()) ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    return fclose(f) == 0;
+}
+
+static bool write_csv(const char* filename, const char* filter, const vector<BenchResult>& results) {
+    FILE* f = fopen(filename, "w");
+    if (!f) {
+        cerr << "Error: no se pudo abrir " << filename << " para escritura" << endl;
+        return false;
+    }
+    fprintf(f, "filter,image,width,height,channels,backend,ranks,threads,reps,median_s,p95_s,min_s,"
+               "mpixel_s,speedup,efficiency,identical\n");
+    for (const BenchResult& r : results) {
+        fprintf(f, "%s,%s,%d,%d,%d,%s,%d,%d,%d,%.9f,%.9f,%.9f,%.3f,%.4f,%.4f,%d\n", filter, r.image.c_str(),
+                r.width, r.height, r.channels, backend_name(r.backend), r.ranks, r.threads, r.reps, r.median,
+                r.p95, r.best, r.mpixels, r.speedup, r.efficiency, r.identical ? 1 : 0);
+    }
+    return fclose(f) == 0;
+}
+
+
+// Separa las banderas del banco de las del filtro (--f, --radius, --border,
+// ...), que se leen con parse_filter_options.
+static bool parse_bench_options(int argc, char* argv[], BenchConfig& cfg, FilterOptions& opt) {
+    const char* dir = "Images";
+    vector<char*> rest(1, argv[0]);
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (strcmp(arg, "--images") == 0 && has_value) {
+            cfg.images = split_list(argv[++i]);
+        } else if (strcmp(arg, "--dir") == 0 && has_value) {
+            dir = argv[++i];
+        } else if (strcmp(arg, "--backends") == 0 && has_value) {
+            cfg.backends.clear();
+            for (const string& name : split_list(argv[++i])) {
+                FilterBackend backend;
+                if (!parse_backend(name.c_str(), backend)) {
+                    cerr << "Error: --backends espera serial, openmp, threads o mpi" << endl;
+                    return false;
+                }
+                cfg.backends.push_back(backend);
+            }
+        } else if (strcmp(arg, "--threads-list") == 0 && has_value) {
+            cfg.threads.clear();
+            for (const string& n : split_list(argv[++i])) {
+                int threads;
+                if (!parse_int_option("--threads-list", n.c_str(), 1, MAX_THREADS, threads)) return false;
+                cfg.threads.push_back(threads);
+            }
+        } else if (strcmp(arg, "--warmup") == 0 && has_value) {
+            if (!parse_int_option(arg, argv[++i], 0, 1000, cfg.warmup)) return false;
+        } else if (strcmp(arg, "--reps") == 0 && has_value) {
+            if (!parse_int_option(arg, argv[++i], 1, 100000, cfg.reps)) return false;
+        } else if (strcmp(arg, "--json") == 0 && has_value) {
+            cfg.json = argv[++i];
+        } else if (strcmp(arg, "--csv") == 0 && has_value) {
+            cfg.csv = argv[++i];
+        } else {
+            rest.push_back(argv[i]);
+        }
+    }
+    if (!parse_filter_options((int) rest.size(), rest.data(), 1, opt)) return false;
+    if (!opt.filter && !opt.kernel_file) opt.filter = "blur";
+
+    // Por defecto: los .pgm de --dir y lena.ppm.
+    if (cfg.images.empty()) {
+        FilterOptions list;
+        list.input_dir = dir;
+        list.glob = "*.pgm";
+        if (!batch_inputs(list, cfg.images)) return false;
+        string color = string(dir) + "/lena.ppm";
+        if (access(color.c_str(), R_OK) == 0) cfg.images.push_back(color);
+    }
+    if (cfg.backends.empty()) {
+        for (FilterBackend backend : { BACKEND_SERIAL, BACKEND_OPENMP, BACKEND_THREADS, BACKEND_MPI }) {
+            if (backend_available(backend)) cfg.backends.push_back(backend);
+        }
+    }
+    // Por defecto 1, 2, 4, ... hasta los nucleos (y los nucleos).
+    if (cfg.threads.empty()) {
+        int cores = max(1, (int) thread::hardware_concurrency());
+        for (int t = 1; t < cores; t *= 2) cfg.threads.push_back(t);
+        cfg.threads.push_back(cores);
+    }
+    return true;
+}
+
+
+static int bench_main(int argc, char* argv[]) {
+    int world;
+    const int rank = world_rank(world);
+
+    BenchConfig cfg;
+    FilterOptions opt;
+    if (!parse_bench_options(argc, argv, cfg, opt)) return 1;
+    if (cfg.images.empty()) {
+        cerr << "Error: no hay imagenes que medir" << endl;
+        return 1;
+    }
+    for (FilterBackend backend : cfg.backends) {
+        if (!backend_available(backend)) {
+            cerr << "Error: el backend " << backend_name(backend) << " no esta disponible en este programa" << endl;
+            return 1;
+        }
+    }
+    Kernel kernel;
+    if (!load_filter_kernel(opt.filter, opt, kernel)) return 1;
+
+    if (rank == 0) {
+        printf("Filtro %s, %d pasadas de calentamiento y %d medidas, %u nucleos, %d proceso(s)\n",
+               opt.filterName(), cfg.warmup, cfg.reps, thread::hardware_concurrency(), world);
+        printf("%-14s %-8s %4s %5s %10s %10s %9s %8s %8s\n", "imagen", "backend", "proc", "hilos",
+               "med (ms)", "p95 (ms)", "Mpx/s", "speedup", "eficien.");
+    }
+
+    vector<BenchResult> results;
+    for (const string& path : cfg.images) {
+        PNMHeader header;
+        if (!pnm_peek_header(path.c_str(), header)) return 1;
+        bool ok = (header.max_color > 255) ? bench_image<uint16_t>(path, kernel, opt, cfg, results)
+                                           : bench_image<uint8_t>(path, kernel, opt, cfg, results);
+        if (!ok) return 1;
+    }
+
+    if (rank != 0) return 0;
+    if (cfg.json && !write_json(cfg.json, opt.filterName(), cfg, results)) return 1;
+    if (cfg.csv && !write_csv(cfg.csv, opt.filterName(), results)) return 1;
+    for (const BenchResult& r : results) {
+        if (!r.identical) {
+            cerr << "Error: la salida de " << backend_name(r.backend) << " en " << r.image
+                 << " no coincide con la serial" << endl;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+        cout << "Uso: " << argv[0] << " [--images a,b,...|--dir Images] [--backends serial,openmp,threads,mpi]"
+             << " [--threads-list 1,2,4] [--warmup N] [--reps N] [--json fichero] [--csv fichero]"
+             << " [--f filtro|--kernel fichero] [opciones del filtro]\n";
+        return 0;
+    }
+#ifdef PNMFILTER_WITH_MPI
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    int status = bench_main(argc, argv);
+    MPI_Finalize();
+    return status;
+#else
+    return bench_main(argc, argv);
+#endif
+}
@@ -0,0 +1,1029 @@
+#ifndef CONVOLVE_H
+#define CONVOLVE_H
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "convolve_simd.h"
+#include "filters.h"
+#include "fft_conv.h"
+
+// Motor de convolucion compartido por los cuatro filtros. Esta plantillado
+// sobre el tipo de muestra (uint8_t / uint16_t) para que la imagen ocupe 1 o
+// 2 bytes por muestra en lugar de un int.
+
+// Como se tratan los vecinos que caen fuera de la imagen.
+enum BorderMode {
+    BORDER_RENORMALIZE,   // se omiten y se divide por la suma de los pesos dentro
+    BORDER_CLAMP,         // se repite el pixel del borde
+    BORDER_MIRROR,        // reflejo sin repetir el borde: -1 -> 1
+    BORDER_WRAP,          // la imagen se repite periodicamente
+    BORDER_ZERO           // valen 0
+};
+
+inline bool parse_border_mode(const char* name, BorderMode& mode) {
+    static const struct { const char* name; BorderMode mode; } modes[] = {
+        {"renormalize", BORDER_RENORMALIZE}, {"clamp", BORDER_CLAMP},
+        {"mirror", BORDER_MIRROR}, {"wrap", BORDER_WRAP}, {"zero", BORDER_ZERO}
+    };
+    for (const auto& m : modes) {
+        if (strcmp(name, m.name) == 0) {
+            mode = m.mode;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Indice en [0, n) que usa el vecino i, o -1 si no aporta (renormalize y
+// zero fuera de la imagen).
+inline int border_index(int i, int n, BorderMode mode) {
+    if (i >= 0 && i < n) return i;
+    switch (mode) {
+        case BORDER_CLAMP: return (i < 0) ? 0 : n - 1;
+        case BORDER_MIRROR:
+            if (n == 1) return 0;
+            while (i < 0 || i >= n) i = (i < 0) ? -i : 2 * (n - 1) - i;
+            return i;
+        case BORDER_WRAP:
+            i %= n;
+            return (i < 0) ? i + n : i;
+        default: return -1;
+    }
+}
+
+
+// Aritmetica de la convolucion. FIXED solo aplica a imagenes de 8 bits y
+// siempre redondea al mas cercano, asi que los cuatro programas coinciden.
+enum ConvPrecision {
+    PRECISION_FLOAT,
+    PRECISION_FIXED
+};
+
+struct ConvOptions {
+    bool round_nearest;   // true: +0.5 antes de truncar (comportamiento de MPI)
+    BorderMode border;
+    ConvPrecision precision;
+    int algorithm;        // -1: eleccion automatica; si no, un ConvAlgorithm forzado
+
+    ConvOptions() : round_nearest(false), border(BORDER_RENORMALIZE), precision(PRECISION_FLOAT),
+                    algorithm(-1) {}
+};
+
+
+// Pesos en punto fijo: w = taps / norm (o taps si norm == 0) por 2^shift.
+// Primero se busca el menor shift que representa los pesos exactamente
+// (laplace, sharpen, sobel...); si no hay, se usa el mayor <= 14 con el que
+// cada peso cabe en int16 (con margen para la correccion) y sum|q| * 255
+// cabe en int32. Con norm != 0 el error de redondeo se carga al peso mayor
+// para que los enteros sumen exactamente 2^shift. Devuelve el shift, o -1
+// si el kernel no se puede representar.
+inline int quantize_taps(const float* taps, int n, float norm, std::vector<int32_t>& q) {
+    double scale = (norm != 0) ? 1.0 / norm : 1.0;
+    double max_w = 0.0, abs_sum = 0.0;
+    for (int i = 0; i < n; i++) {
+        max_w = std::max(max_w, fabs(taps[i] * scale));
+        abs_sum += fabs(taps[i] * scale);
+    }
+
+    int shift = -1;
+    for (int s = 0; s <= 14 && shift < 0 && abs_sum * (1 << s) * 255.0 <= (double) (1 << 30); s++) {
+        bool exact = true;
+        for (int i = 0; i < n && exact; i++) {
+            double v = taps[i] * scale * (1 << s);
+            exact = (v == nearbyint(v));
+        }
+        if (exact) shift = s;
+    }
+    if (shift < 0) {
+        shift = 14;
+        while (shift > 0 && (max_w * (1 << shift) > 32000.0 || abs_sum * (1 << shift) > (double) (1 << 23))) shift--;
+        if (shift == 0) return -1;
+    }
+
+    q.resize(n);
+    int64_t sum = 0;
+    int largest = 0;
+    for (int i = 0; i < n; i++) {
+        q[i] = (int32_t) lround(taps[i] * scale * (1 << shift));
+        sum += q[i];
+        if (std::abs(q[i]) > std::abs(q[largest])) largest = i;
+    }
+    if (norm != 0) q[largest] += (int32_t) ((1 << shift) - sum);
+    return shift;
+}
+
+// Si sum|q| * 255 + 2^shift cabe en int16, el 3x3 puede acumular en 16 bits.
+inline bool fixed_fits_int16(const std::vector<int32_t>& q, int shift) {
+    int64_t abs_sum = 0;
+    for (int32_t v : q) abs_sum += std::abs(v);
+    return abs_sum * 255 + (1 << shift) <= 32767;
+}
+
+// floor(a / d) para d != 0.
+inline int64_t div_floor(int64_t a, int64_t d) {
+    if (d < 0) {
+        a = -a;
+        d = -d;
+    }
+    int64_t q = a / d;
+    return (a % d < 0) ? q - 1 : q;
+}
+
+// a / d redondeado al entero mas cercano (las mitades hacia arriba), como
+// (a + d/2) >> shift cuando d = 2^shift.
+inline int64_t div_round(int64_t a, int64_t d) {
+    if (d < 0) {
+        a = -a;
+        d = -d;
+    }
+    int64_t q = a / d, r = a % d;
+    if (r < 0) {
+        q--;
+        r += d;
+    }
+    return q + (2 * r >= d);
+}
+
+
+// Kernel cuadrado de lado impar guardado por filas.
+struct Kernel {
+    int size;
+    std::vector<float> taps;
+    const char* name;     // filtro predefinido de filters.h, o nullptr
+
+    Kernel() : size(0), name(nullptr) {}
+
+    int radius() const { return size / 2; }
+
+    // ky, kx en [-radius, radius]
+    float at(int ky, int kx) const {
+        return taps[(ky + radius()) * size + (kx + radius())];
+    }
+};
+
+const int MAX_BLUR_RADIUS = 50;
+const int MAX_KERNEL_SIZE = 31;     // gaussian y --kernel
+
+
+template <typename F>
+inline Kernel kernel_from_filter() {
+    float weights[9];
+    static_filter_weights<F>(weights);
+    Kernel kernel;
+    kernel.size = 3;
+    kernel.taps.assign(weights, weights + 9);
+    kernel.name = F::name;
+    return kernel;
+}
+
+// Blur de caja (2r+1)x(2r+1) con todos los pesos iguales.
+inline Kernel box_kernel(int radius) {
+    Kernel kernel;
+    kernel.size = 2 * radius + 1;
+    kernel.taps.assign(kernel.size * kernel.size, 1.0f / (kernel.size * kernel.size));
+    return kernel;
+}
+
+// Gaussiana (2r+1)x(2r+1) con sigma = r/2, normalizada a suma 1. Es el
+// producto externo de dos vectores, asi que el plan la filtra como separable.
+inline Kernel gaussian_kernel(int radius) {
+    double sigma = radius / 2.0;
+    std::vector<double> g(2 * radius + 1);
+    double sum = 0.0;
+    for (int i = -radius; i <= radius; i++) {
+        g[i + radius] = exp(-(i * i) / (2.0 * sigma * sigma));
+        sum += g[i + radius];
+    }
+
+    Kernel kernel;
+    kernel.size = 2 * radius + 1;
+    kernel.taps.resize(kernel.size * kernel.size);
+    for (int i = 0; i < kernel.size; i++) {
+        for (int j = 0; j < kernel.size; j++) kernel.taps[i * kernel.size + j] = (float) (g[i] * g[j] / (sum * sum));
+    }
+    return kernel;
+}
+
+
+// Kernels disponibles con --f. radius solo se usa en blur y gaussian; el
+// nombre debe existir y radius estar en rango (ver filter_kernel_error).
+inline bool filter_kernel(const char* name, int radius, Kernel& kernel) {
+    if (strcmp(name, "blur") == 0) kernel = (radius == 1) ? kernel_from_filter<BlurFilter>() : box_kernel(radius);
+    else if (strcmp(name, "gaussian") == 0 && 2 * radius + 1 <= MAX_KERNEL_SIZE) kernel = gaussian_kernel(radius);
+    else if (strcmp(name, "laplace") == 0) kernel = kernel_from_filter<LaplaceFilter>();
+    else if (strcmp(name, "sharpen") == 0) kernel = kernel_from_filter<SharpenFilter>();
+    else if (strcmp(name, "sobel") == 0) kernel = kernel_from_filter<SobelFilter>();
+    else if (strcmp(name, "emboss") == 0) kernel = kernel_from_filter<EmbossFilter>();
+    else return false;
+    return true;
+}
+
+// Mensaje para un filter_kernel que fallo.
+inline void filter_kernel_error(const char* name, int radius) {
+    if (strcmp(name, "gaussian") == 0) {
+        std::cerr << "Error: gaussian admite --radius hasta " << MAX_KERNEL_SIZE / 2
+                  << " (pedido " << radius << ")" << std::endl;
+    } else {
+        std::cerr << "Filtro no reconocido: " << name << std::endl;
+    }
+}
+
+
+// Kernel de usuario (--kernel): N x N numeros por filas, con N impar
+// <= 31, separados por espacios o saltos de linea. '#' comenta hasta el fin
+// de la linea. Los pesos se normalizan por su suma si no es 0, igual que los
+// predefinidos.
+inline bool load_kernel_file(const char* filename, Kernel& kernel) {
+    FILE* file = fopen(filename, "r");
+    if (!file) {
+        std::cerr << "Error: no se pudo abrir el kernel " << filename << std::endl;
+        return false;
+    }
+    std::string text;
+    char chunk[4096];
+    size_t got;
+    while ((got = fread(chunk, 1, sizeof(chunk), file)) > 0) text.append(chunk, got);
+    fclose(file);
+
+    std::vector<float> taps;
+    const char* p = text.c_str();
+    while (*p) {
+        if (*p == '#') {
+            while (*p && *p != '\n') p++;
+        } else if (isspace((unsigned char) *p)) {
+            p++;
+        } else {
+            char* end = nullptr;
+            float value = strtof(p, &end);
+            if (end == p) {
+                std::cerr << "Error: valor no numerico en " << filename << ": '" << *p << "'" << std::endl;
+                return false;
+            }
+            taps.push_back(value);
+            p = end;
+        }
+    }
+
+    int n = (int) lround(sqrt((double) taps.size()));
+    if (taps.empty() || (size_t) n * n != taps.size() || n % 2 == 0 || n > MAX_KERNEL_SIZE) {
+        std::cerr << "Error: " << filename << " tiene " << taps.size()
+                  << " valores; se esperan N x N con N impar <= " << MAX_KERNEL_SIZE << std::endl;
+        return false;
+    }
+
+    kernel = Kernel();
+    kernel.size = n;
+    kernel.taps = taps;
+    return true;
+}
+
+
+enum ConvAlgorithm {
+    CONV_DIRECT,       // suma de los size*size taps por pixel
+    CONV_SEPARABLE,    // kernel = columna x fila: pasada horizontal + vertical
+    CONV_BOX,          // todos los pesos iguales: sumas corridas, O(1) por pixel
+    CONV_STATIC,       // filtro de filters.h: instanciacion con taps constantes
+    CONV_FFT           // kernels grandes no separables: bloques por FFT
+};
+
+inline const char* conv_algorithm_name(ConvAlgorithm algorithm) {
+    switch (algorithm) {
+        case CONV_SEPARABLE: return "separable";
+        case CONV_BOX: return "box";
+        case CONV_STATIC: return "especializado";
+        case CONV_FFT: return "fft";
+        default: return "directo";
+    }
+}
+
+
+// Lado minimo a partir del cual un kernel no separable va por FFT en la
+// eleccion automatica (ver bench_conv y la tabla del README).
+const int FFT_MIN_KERNEL_SIZE = 7;
+
+// Lado F (potencia de 2) de los bloques FFT para radio r: minimiza el coste
+// por pixel util, F^2 log F / (F - 2r)^2, sin pasar mucho del tamano de la
+// imagen.
+inline int fft_block_size(int r, int width, int height) {
+    int limit = 16;
+    while (limit < std::max(width, height) + 2 * r && limit < 512) limit <<= 1;
+    int best = 0;
+    double best_cost = 0.0;
+    for (int f = 8, bits = 3; f <= limit; f <<= 1, bits++) {
+        int useful = f - 2 * r;
+        if (useful < 1) continue;
+        double cost = (double) f * f * bits / ((double) useful * useful);
+        if (best == 0 || cost < best_cost) {
+            best = f;
+            best_cost = cost;
+        }
+    }
+    return best;
+}
+
+inline bool kernel_is_box(const Kernel& k) {
+    if (k.taps.empty() || k.taps[0] == 0.0f) return false;
+    for (size_t i = 1; i < k.taps.size(); i++) {
+        if (k.taps[i] != k.taps[0]) return false;
+    }
+    return true;
+}
+
+// Intenta escribir el kernel como producto externo col * row (rango 1).
+inline bool kernel_separate(const Kernel& k, std::vector<float>& col, std::vector<float>& row) {
+    int n = k.size;
+    int pivot = 0;
+    for (int i = 1; i < n * n; i++) {
+        if (fabsf(k.taps[i]) > fabsf(k.taps[pivot])) pivot = i;
+    }
+    float p = k.taps[pivot];
+    if (p == 0.0f) return false;
+
+    int pi = pivot / n, pj = pivot % n;
+    col.resize(n);
+    row.resize(n);
+    for (int i = 0; i < n; i++) col[i] = k.taps[i * n + pj];
+    for (int j = 0; j < n; j++) row[j] = k.taps[pi * n + j] / p;
+
+    float tolerance = 1e-6f * fabsf(p);
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            if (fabsf(k.taps[i * n + j] - col[i] * row[j]) > tolerance) return false;
+        }
+    }
+    return true;
+}
+
+
+// Plan de convolucion para una imagen de width x height: analiza el kernel
+// una vez y elige el algoritmo. run() se puede llamar desde varios hilos a
+// la vez sobre regiones distintas.
+template <typename T>
+class ConvPlan {
+private:
+    Kernel kernel;
+    int width, height, channels, max_color;
+    ConvOptions opt;
+    ConvAlgorithm algo;
+    float tap_sum;                     // suma de los taps en orden de filas
+    std::vector<float> col, row;       // factores del kernel separable
+    std::vector<double> inv_count;     // box: 1/n para n = 0..size*size
+    typename Conv3x3Row<T>::Fn row3x3; // directo 3x3: nucleo del interior
+    Conv3x3Params params3x3;
+    const char* isa;
+
+    // --precision fixed (solo T = uint8_t)
+    bool fixed;
+    int fixed_shift;                   // directo: bits de fraccion de qtaps
+    int row_shift, col_shift;          // separable
+    std::vector<int32_t> qtaps, qrow, qcol;
+    Conv3x3FixedFn row3x3_fixed;
+    Conv3x3FixedParams fixed3x3;
+
+    const StaticFilter<T>* static_filter;   // CONV_STATIC
+    int32_t static_taps[9];
+    int64_t static_full;
+
+    FFTConvolver fft;                  // CONV_FFT
+
+    T clampResult(float value) const {
+        int result = static_cast<int>(value + (opt.round_nearest ? 0.5f : 0.0f));
+        return (T) std::max(0, std::min(max_color, result));
+    }
+
+    // En los bordes de las pasadas box y separable: con renormalize solo
+    // se recorren los vecinos dentro; el resto de modos usa la ventana
+    // completa sobre filas/columnas virtuales.
+    bool renormalize() const { return opt.border == BORDER_RENORMALIZE; }
+
+    // R > 0 fija el radio en compilacion (3x3 con R = 1); R = 0 usa el
+    // radio del kernel.
+    // Las escrituras a T* (uint8_t) pueden solapar cualquier dato, asi que
+    // los miembros se copian a variables locales antes de los bucles.
+    //
+    // Interior: todos los taps caen dentro de la imagen, sin comprobaciones
+    // y con la normalizacion precalculada.
+    template <int R>
+    void directInterior(const T* src, int x0, int x1, int y0, int y1, T* dst, size_t dst_pitch) const {
+        const int r = (R > 0) ? R : kernel.radius();
+        const int n = 2 * r + 1;
+        const int ch = channels, maxc = max_color;
+        const size_t row_len = (size_t) width * ch;
+        const float norm = tap_sum, bias = opt.round_nearest ? 0.5f : 0.0f;
+        const bool divide = (norm != 0);
+
+        float fixed_taps[(2 * R + 1) * (2 * R + 1)];
+        const float* taps = kernel.taps.data();
+        if (R > 0) {
+            std::copy(kernel.taps.begin(), kernel.taps.end(), fixed_taps);
+            taps = fixed_taps;
+        }
+
+        for (int y = y0; y < y1; y++) {
+            T* out_row = dst + (size_t) (y - y0) * dst_pitch;
+            for (int x = x0; x < x1; x++) {
+                const T* corner = src + (size_t) (y - r) * row_len + (size_t) (x - r) * ch;
+                for (int c = 0; c < ch; c++) {
+                    float sum = 0.0f;
+                    for (int ky = 0; ky < n; ky++) {
+                        const T* p = corner + (size_t) ky * row_len + c;
+                        for (int kx = 0; kx < n; kx++) sum += p[kx * ch] * taps[ky * n + kx];
+                    }
+                    float value = divide ? sum / norm : sum;
+                    int result = static_cast<int>(value + bias);
+                    out_row[(size_t) x * ch + c] = (T) std::max(0, std::min(maxc, result));
+                }
+            }
+        }
+    }
+
+    // Marco: cada vecino pasa por border_index segun el modo elegido.
+    template <int R>
+    void directBorder(const T* src, int x0, int x1, int y0, int y1, T* dst, size_t dst_pitch) const {
+        const int r = (R > 0) ? R : kernel.radius();
+        const int n = 2 * r + 1;
+        const int w = width, h = height, ch = channels, maxc = max_color;
+        const BorderMode mode = opt.border;
+        const float norm = tap_sum, bias = opt.round_nearest ? 0.5f : 0.0f;
+        const float* taps = kernel.taps.data();
+
+        for (int y = y0; y < y1; y++) {
+            T* out_row = dst + (size_t) (y - y0) * dst_pitch;
+            for (int x = x0; x < x1; x++) {
+                for (int c = 0; c < ch; c++) {
+                    float sum = 0.0f;
+                    float weight_sum = 0.0f;
+
+                    for (int ky = -r; ky <= r; ky++) {
+                        int ny = border_index(y + ky, h, mode);
+                        if (ny < 0) continue;
+                        for (int kx = -r; kx <= r; kx++) {
+                            int nx = border_index(x + kx, w, mode);
+                            if (nx < 0) continue;
+                            float k = taps[(ky + r) * n + (kx + r)];
+                            sum += src[((size_t) ny * w + nx) * ch + c] * k;
+                            weight_sum += k;
+                        }
+                    }
+
+                    float weight = (mode == BORDER_RENORMALIZE) ? weight_sum : norm;
+                    float value = (weight != 0) ? sum / weight : sum;
+                    int result = static_cast<int>(value + bias);
+                    out_row[(size_t) x * ch + c] = (T) std::max(0, std::min(maxc, result));
+                }
+            }
+        }
+    }
+
+    // Punto fijo: las mismas dos rutas con pesos enteros. El interior
+    // divide por 2^fixed_shift con un desplazamiento; en el marco el divisor
+    // es la suma de pesos que usa el modo de borde (2^fixed_shift si es 0).
+    template <int R>
+    void directInteriorFixed(const T* src, int x0, int x1, int y0, int y1, T* dst, size_t dst_pitch) const {
+        const int r = (R > 0) ? R : kernel.radius();
+        const int n = 2 * r + 1;
+        const int ch = channels, maxc = max_color, shift = fixed_shift;
+        const size_t row_len = (size_t) width * ch;
+        const int32_t half = (1 << shift) >> 1;
+
+        int32_t fixed_taps[(2 * R + 1) * (2 * R + 1)];
+        const int32_t* taps = qtaps.data();
+        if (R > 0) {
+            std::copy(qtaps.begin(), qtaps.end(), fixed_taps);
+            taps = fixed_taps;
+        }
+
+        for (int y = y0; y < y1; y++) {
+            T* out_row = dst + (size_t) (y - y0) * dst_pitch;
+            for (int x = x0; x < x1; x++) {
+                const T* corner = src + (size_t) (y - r) * row_len + (size_t) (x - r) * ch;
+                for (int c = 0; c < ch; c++) {
+                    int32_t acc = half;
+                    for (int ky = 0; ky < n; ky++) {
+                        const T* p = corner + (size_t) ky * row_len + c;
+                        for (int kx = 0; kx < n; kx++) acc += p[kx * ch] * taps[ky * n + kx];
+                    }
+                    int result = acc >> shift;
+                    out_row[(size_t) x * ch + c] = (T) std::max(0, std::min(maxc, result));
+                }
+            }
+        }
+    }
+
+    // Marco con pesos enteros: qtaps en punto fijo o los taps del filtro
+    // predefinido. full es el divisor con la ventana completa y fallback el
+    // de renormalize cuando los pesos dentro suman 0 (equivalen a norm y a
+    // "no dividir" de la ruta float).
+    template <int R>
+    void directBorderInt(const T* src, int x0, int x1, int y0, int y1, T* dst, size_t dst_pitch,
+                         const int32_t* taps, int64_t full, int64_t fallback, bool round) const {
+        const int r = (R > 0) ? R : kernel.radius();
+        const int n = 2 * r + 1;
+        const int w = width, h = height, ch = channels, maxc = max_color;
+        const BorderMode mode = opt.border;
+
+        for (int y = y0; y < y1; y++) {
+            T* out_row = dst + (size_t) (y - y0) * dst_pitch;
+            for (int x = x0; x < x1; x++) {
+                for (int c = 0; c < ch; c++) {
+                    int64_t acc = 0, weight_sum = 0;
+                    for (int ky = -r; ky <= r; ky++) {
+                        int ny = border_index(y + ky, h, mode);
+                        if (ny < 0) continue;
+                        for (int kx = -r; kx <= r; kx++) {
+                            int nx = border_index(x + kx, w, mode);
+                            if (nx < 0) continue;
+                            int32_t k = taps[(ky + r) * n + (kx + r)];
+                            acc += src[((size_t) ny * w + nx) * ch + c] * k;
+                            weight_sum += k;
+                        }
+                    }
+
+                    int64_t weight = full;
+                    if (mode == BORDER_RENORMALIZE) weight = (weight_sum != 0) ? weight_sum : fallback;
+                    int64_t result = round ? div_round(acc, weight) : div_floor(acc, weight);
+                    out_row[(size_t) x * ch + c] = (T) std::max<int64_t>(0, std::min<int64_t>(maxc, result));
+                }
+            }
+        }
+    }
+
+    template <int R>
+    void directBorderAny(const T* src, int x0, int x1, int y0, int y1, T* dst, size_t dst_pitch) const {
+        if (static_filter) {
+            directBorderInt<R>(src, x0, x1, y0, y1, dst, dst_pitch, static_taps, static_full,
+                               static_filter->divisor, opt.round_nearest || fixed);
+        } else if (fixed) {
+            int64_t one = (int64_t) 1 << fixed_shift;
+            directBorderInt<R>(src, x0, x1, y0, y1, dst, dst_pitch, qtaps.data(), one, one, true);
+        } else {
+            directBorder<R>(src, x0, x1, y0, y1, dst, dst_pitch);
+        }
+    }
+
+    // Interior por FFT: bloques de tileSize() x tileSize() pixeles por
+    // canal, de dos en dos (parte real e imaginaria). La rejilla de bloques
+    // y las parejas son fijas para toda la imagen, asi que un pixel sale
+    // igual sea cual sea la region pedida. La entrada de cada bloque llega r
+    // pixeles mas alla; lo que cae fuera de la imagen es 0.
+    void fftInterior(const T* src, int x0, int x1, int y0, int y1, T* dst, size_t dst_pitch) const {
+        const int F = fft.fftSize(), U = fft.tileSize(), r = kernel.radius();
+        const int ch = channels, maxc = max_color;
+        const int jobs = ((width + U - 1) / U) * ch;    // por fila de bloques
+        const size_t row_len = (size_t) width * ch;
+        // El epsilon evita que un entero exacto salga como x.999999.
+        const double bias = (opt.round_nearest ? 0.5 : 0.0) + 1e-6;
+        std::vector<FFTComplex> buf((size_t) F * F);
+
+        for (int oy = (y0 / U) * U; oy < y1; oy += U) {
+            for (int job = 0; job < jobs; job += 2) {
+                int first_x = (job / ch) * U, last_x = (std::min(job + 1, jobs - 1) / ch) * U;
+                if (first_x >= x1 || last_x + U <= x0) continue;
+
+                for (int half = 0; half < 2; half++) {
+                    int j = job + half, c = j % ch, ox = (j / ch) * U;
+                    for (int yy = 0; yy < F; yy++) {
+                        int sy = oy - r + yy;
+                        bool row_in = (j < jobs && sy >= 0 && sy < height);
+                        FFTComplex* line = buf.data() + (size_t) yy * F;
+                        for (int xx = 0; xx < F; xx++) {
+                            int sx = ox - r + xx;
+                            double v = (row_in && sx >= 0 && sx < width) ? src[(size_t) sy * row_len + (size_t) sx * ch + c] : 0.0;
+                            if (half == 0) line[xx] = FFTComplex(v, 0.0);
+                            else line[xx].imag(v);
+                        }
+                    }
+                }
+
+                fft.convolvePair(buf.data());
+
+                for (int half = 0; half < 2 && job + half < jobs; half++) {
+                    int j = job + half, c = j % ch, ox = (j / ch) * U;
+                    int bx0 = std::max(ox, x0), bx1 = std::min(ox + U, x1);
+                    int by0 = std::max(oy, y0), by1 = std::min(oy + U, y1);
+                    for (int y = by0; y < by1; y++) {
+                        const FFTComplex* line = buf.data() + (size_t) (r + y - oy) * F + r;
+                        T* out = dst + (size_t) (y - y0) * dst_pitch + c;
+                        for (int x = bx0; x < bx1; x++) {
+                            double v = (half == 0) ? line[x - ox].real() : line[x - ox].imag();
+                            int result = static_cast<int>(v + bias);
+                            out[(size_t) x * ch] = (T) std::max(0, std::min(maxc, result));
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Separa la region en interior (ruta sin comprobaciones; nucleo
+    // vectorial en 3x3) y las cuatro franjas del marco.
+    template <int R>
+    void runDirect(const T* src, int x0, int x1, int y0, int y1, T* dst, size_t dst_pitch) const {
+        const int r = (R > 0) ? R : kernel.radius();
+        int ix0 = std::max(x0, r), ix1 = std::min(x1, width - r);
+        int iy0 = std::max(y0, r), iy1 = std::min(y1, height - r);
+        if (ix0 >= ix1 || iy0 >= iy1) {
+            directBorderAny<R>(src, x0, x1, y0, y1, dst, dst_pitch);
+            return;
+        }
+
+        directBorderAny<R>(src, x0, x1, y0, iy0, dst, dst_pitch);
+        directBorderAny<R>(src, x0, x1, iy1, y1, dst + (size_t) (iy1 - y0) * dst_pitch, dst_pitch);
+        directBorderAny<R>(src, x0, ix0, iy0, iy1, dst + (size_t) (iy0 - y0) * dst_pitch, dst_pitch);
+        directBorderAny<R>(src, ix1, x1, iy0, iy1, dst + (size_t) (iy0 - y0) * dst_pitch, dst_pitch);
+
+        T* interior = dst + (size_t) (iy0 - y0) * dst_pitch;
+        if (R == 1 && static_filter) {
+            typename StaticFilter<T>::Fn fn = (channels == 3) ? static_filter->rgb : static_filter->gray;
+            fn(src, width, ix0, ix1, iy0, iy1, interior, dst_pitch, max_color, opt.round_nearest || fixed);
+            return;
+        }
+
+        if (algo == CONV_FFT) {
+            fftInterior(src, ix0, ix1, iy0, iy1, interior, dst_pitch);
+            return;
+        }
+
+        const bool vector3x3 = (R == 1) && (fixed ? row3x3_fixed != nullptr : row3x3 != nullptr);
+        if (!vector3x3) {
+            if (fixed) directInteriorFixed<R>(src, ix0, ix1, iy0, iy1, interior, dst_pitch);
+            else directInterior<R>(src, ix0, ix1, iy0, iy1, interior, dst_pitch);
+            return;
+        }
+
+        const size_t row_len = (size_t) width * channels;
+        const int count = (ix1 - ix0) * channels;
+        for (int y = iy0; y < iy1; y++) {
+            const T* mid = src + (size_t) y * row_len + (size_t) ix0 * channels;
+            T* out = interior + (size_t) (y - iy0) * dst_pitch + (size_t) ix0 * channels;
+            if constexpr (sizeof(T) == 1) {
+                if (fixed) {
+                    row3x3_fixed(mid - row_len, mid, mid + row_len, out, count, channels, fixed3x3);
+                    continue;
+                }
+            }
+            row3x3(mid - row_len, mid, mid + row_len, out, count, channels, params3x3);
+        }
+    }
+
+    // Pasada horizontal del separable para la fila yy en [x0, x1). yy puede
+    // estar fuera de la imagen si el modo de borde no es renormalize.
+    void separableRow(const T* src, int yy, int x0, int x1, float* out) const {
+        const int r = kernel.radius();
+        const BorderMode mode = opt.border;
+        int sy = border_index(yy, height, mode);
+        if (sy < 0) {
+            std::fill(out, out + (size_t) (x1 - x0) * channels, 0.0f);
+            return;
+        }
+
+        const T* in = src + (size_t) sy * width * channels;
+        for (int x = x0; x < x1; x++) {
+            int k0 = std::max(-r, -x), k1 = std::min(r, width - 1 - x);
+            for (int c = 0; c < channels; c++) {
+                float s = 0.0f;
+                if (mode == BORDER_RENORMALIZE || (k0 == -r && k1 == r)) {
+                    for (int kx = k0; kx <= k1; kx++) s += in[(size_t) (x + kx) * channels + c] * row[kx + r];
+                } else {
+                    for (int kx = -r; kx <= r; kx++) {
+                        int sx = border_index(x + kx, width, mode);
+                        if (sx >= 0) s += in[(size_t) sx * channels + c] * row[kx + r];
+                    }
+                }
+                out[(size_t) (x - x0) * channels + c] = s;
+            }
+        }
+    }
+
+    void runSeparable(const T* src, int x0, int x1, int y0, int y1, T* dst, size_t dst_pitch) const {
+        const int r = kernel.radius();
+        const int n = kernel.size;
+        const size_t row_len = (size_t) (x1 - x0) * channels;
+        const bool clip = renormalize();
+        const int base = y0 - r;   // fila virtual del primer hueco del anillo
+
+        // Anillo con las 2r+1 filas horizontales que cubre el kernel.
+        std::vector<float> ring(n * row_len);
+        std::vector<float> hweight(x1 - x0);
+        for (int x = x0; x < x1; x++) {
+            int k0 = clip ? std::max(-r, -x) : -r, k1 = clip ? std::min(r, width - 1 - x) : r;
+            float w = 0.0f;
+            for (int kx = k0; kx <= k1; kx++) w += row[kx + r];
+            hweight[x - x0] = w;
+        }
+
+        int next = clip ? std::max(0, y0 - r) : y0 - r;
+        for (int y = y0; y < y1; y++) {
+            int last = clip ? std::min(height - 1, y + r) : y + r;
+            for (; next <= last; next++) separableRow(src, next, x0, x1, &ring[((next - base) % n) * row_len]);
+
+            int k0 = clip ? std::max(-r, -y) : -r, k1 = clip ? std::min(r, height - 1 - y) : r;
+            float vweight = 0.0f;
+            for (int ky = k0; ky <= k1; ky++) vweight += col[ky + r];
+
+            T* out_row = dst + (size_t) (y - y0) * dst_pitch + (size_t) x0 * channels;
+            for (size_t i = 0; i < row_len; i++) {
+                float s = 0.0f;
+                for (int ky = k0; ky <= k1; ky++) s += ring[((y + ky - base) % n) * row_len + i] * col[ky + r];
+                float weight = hweight[i / channels] * vweight;
+                out_row[i] = clampResult((weight != 0) ? s / weight : s);
+            }
+        }
+    }
+
+    // Separable en punto fijo: pasada horizontal en int32 y vertical en
+    // int64. El divisor es el producto de las sumas de pesos de cada pasada,
+    // 2^(row_shift + col_shift) en el interior.
+    void separableRowFixed(const T* src, int yy, int x0, int x1, int32_t* out) const {
+        const int r = kernel.radius();
+        const BorderMode mode = opt.border;
+        const int32_t* q = qrow.data();
+        int sy = border_index(yy, height, mode);
+        if (sy < 0) {
+            std::fill(out, out + (size_t) (x1 - x0) * channels, 0);
+            return;
+        }
+
+        const T* in = src + (size_t) sy * width * channels;
+        for (int x = x0; x < x1; x++) {
+            int k0 = std::max(-r, -x), k1 = std::min(r, width - 1 - x);
+            for (int c = 0; c < channels; c++) {
+                int32_t s = 0;
+                if (mode == BORDER_RENORMALIZE || (k0 == -r && k1 == r)) {
+                    for (int kx = k0; kx <= k1; kx++) s += in[(size_t) (x + kx) * channels + c] * q[kx + r];
+                } else {
+                    for (int kx = -r; kx <= r; kx++) {
+                        int sx = border_index(x + kx, width, mode);
+                        if (sx >= 0) s += in[(size_t) sx * channels + c] * q[kx + r];
+                    }
+                }
+                out[(size_t) (x - x0) * channels + c] = s;
+            }
+        }
+    }
+
+    void runSeparableFixed(const T* src, int x0, int x1, int y0, int y1, T* dst, size_t dst_pitch) const {
+        const int r = kernel.radius();
+        const int n = kernel.size;
+        const size_t row_len = (size_t) (x1 - x0) * channels;
+        const bool clip = renormalize();
+        const int base = y0 - r;
+        const int total_shift = row_shift + col_shift;
+        const int64_t full = (int64_t) 1 << total_shift;
+
+        std::vector<int32_t> ring(n * row_len);
+        std::vector<int64_t> hweight(x1 - x0);
+        for (int x = x0; x < x1; x++) {
+            int k0 = clip ? std::max(-r, -x) : -r, k1 = clip ? std::min(r, width - 1 - x) : r;
+            int64_t w = 0;
+            for (int kx = k0; kx <= k1; kx++) w += qrow[kx + r];
+            hweight[x - x0] = w;
+        }
+
+        int next = clip ? std::max(0, y0 - r) : y0 - r;
+        for (int y = y0; y < y1; y++) {
+            int last = clip ? std::min(height - 1, y + r) : y + r;
+            for (; next <= last; next++) separableRowFixed(src, next, x0, x1, &ring[((next - base) % n) * row_len]);
+
+            int k0 = clip ? std::max(-r, -y) : -r, k1 = clip ? std::min(r, height - 1 - y) : r;
+            int64_t vweight = 0;
+            for (int ky = k0; ky <= k1; ky++) vweight += qcol[ky + r];
+
+            T* out_row = dst + (size_t) (y - y0) * dst_pitch + (size_t) x0 * channels;
+            for (size_t i = 0; i < row_len; i++) {
+                int64_t acc = 0;
+                for (int ky = k0; ky <= k1; ky++) acc += (int64_t) ring[((y + ky - base) % n) * row_len + i] * qcol[ky + r];
+                int64_t weight = hweight[i / channels] * vweight;
+                int64_t result = (weight == full || weight == 0) ? (acc + full / 2) >> total_shift
+                                                                 : div_round(acc, weight);
+                out_row[i] = (T) std::max<int64_t>(0, std::min<int64_t>(max_color, result));
+            }
+        }
+    }
+
+    // Suma horizontal de la ventana [x-r, x+r] con suma corrida. Solo las
+    // columnas cerca del borde pasan por border_index; los vecinos que no
+    // aportan (renormalize, zero) suman 0.
+    void boxRow(const T* src, int yy, int x0, int x1, uint32_t* out) const {
+        const int r = kernel.radius();
+        const int w = width, ch = channels;
+        const BorderMode mode = opt.border;
+        int sy = border_index(yy, height, mode);
+        if (sy < 0) {
+            std::fill(out, out + (size_t) (x1 - x0) * ch, 0u);
+            return;
+        }
+
+        const T* in = src + (size_t) sy * w * ch;
+        // Columnas con x-r-1 >= 0 y x+r < width: sin comprobaciones.
+        const int xa = std::min(x1, std::max(x0 + 1, r + 1));
+        const int xb = std::max(xa, std::min(x1, w - r));
+        for (int c = 0; c < ch; c++) {
+            auto sample = [&](int xx) -> uint32_t {
+                int sx = border_index(xx, w, mode);
+                return (sx < 0) ? 0 : in[(size_t) sx * ch + c];
+            };
+
+            uint32_t s = 0;
+            for (int x = x0 - r; x <= x0 + r; x++) s += sample(x);
+            out[c] = s;
+            int x = x0 + 1;
+            for (; x < xa; x++) {
+                s += sample(x + r);
+                s -= sample(x - r - 1);
+                out[(size_t) (x - x0) * ch + c] = s;
+            }
+            for (; x < xb; x++) {
+                s += in[(size_t) (x + r) * ch + c];
+                s -= in[(size_t) (x - r - 1) * ch + c];
+                out[(size_t) (x - x0) * ch + c] = s;
+            }
+            for (; x < x1; x++) {
+                s += sample(x + r);
+                s -= sample(x - r - 1);
+                out[(size_t) (x - x0) * ch + c] = s;
+            }
+        }
+    }
+
+    void runBox(const T* src, int x0, int x1, int y0, int y1, T* dst, size_t dst_pitch) const {
+        const int r = kernel.radius();
+        const int n = kernel.size;
+        const size_t row_len = (size_t) (x1 - x0) * channels;
+        const double bias = ((opt.round_nearest || fixed) ? 0.5 : 0.0) + 1e-6;
+        const bool clip = renormalize();
+        const int base = y0 - r;
+
+        std::vector<uint32_t> ring(n * row_len);
+        std::vector<uint32_t> column(row_len, 0);
+        std::vector<int> hcount(x1 - x0);
+        for (int x = x0; x < x1; x++) {
+            hcount[x - x0] = clip ? std::min(width - 1, x + r) - std::max(0, x - r) + 1 : n;
+        }
+
+        // Ventana vertical inicial: filas [y0-r, y0+r] (con renormalize,
+        // solo las que caen dentro de la imagen).
+        int first = clip ? std::max(0, y0 - r) : y0 - r;
+        int last = clip ? std::min(height - 1, y0 + r) : y0 + r;
+        for (int yy = first; yy <= last; yy++) {
+            uint32_t* h = &ring[((yy - base) % n) * row_len];
+            boxRow(src, yy, x0, x1, h);
+            for (size_t i = 0; i < row_len; i++) column[i] += h[i];
+        }
+
+        for (int y = y0; y < y1; y++) {
+            if (y > y0) {
+                // La fila que sale (y-r-1) y la que entra (y+r) comparten hueco.
+                int leaving = y - r - 1, entering = y + r;
+                if (!clip || leaving >= 0) {
+                    const uint32_t* h = &ring[((leaving - base) % n) * row_len];
+                    for (size_t i = 0; i < row_len; i++) column[i] -= h[i];
+                }
+                if (!clip || entering < height) {
+                    uint32_t* h = &ring[((entering - base) % n) * row_len];
+                    boxRow(src, entering, x0, x1, h);
+                    for (size_t i = 0; i < row_len; i++) column[i] += h[i];
+                }
+            }
+
+            int vcount = clip ? std::min(height - 1, y + r) - std::max(0, y - r) + 1 : n;
+            T* out_row = dst + (size_t) (y - y0) * dst_pitch + (size_t) x0 * channels;
+            for (int x = x0; x < x1; x++) {
+                double inv = inv_count[hcount[x - x0] * vcount];
+                for (int c = 0; c < channels; c++) {
+                    size_t i = (size_t) (x - x0) * channels + c;
+                    int result = (int) (column[i] * inv + bias);
+                    out_row[i] = (T) std::min(max_color, result);
+                }
+            }
+        }
+    }
+
+public:
+    ConvPlan(const Kernel& k, int width_, int height_, int channels_, int max_color_,
+             const ConvOptions& opt_)
+        : kernel(k), width(width_), height(height_), channels(channels_),
+          max_color(max_color_), opt(opt_), algo(CONV_DIRECT), tap_sum(0.0f),
+          row3x3(nullptr), isa("escalar"), fixed(false), fixed_shift(0), row_shift(0),
+          col_shift(0), row3x3_fixed(nullptr), static_filter(nullptr) {
+        for (float t : kernel.taps) tap_sum += t;
+
+        // opt.algorithm >= 0 restringe la eleccion a ese algoritmo (si el
+        // kernel lo admite; si no, queda el directo).
+        auto allowed = [&](ConvAlgorithm a) { return opt.algorithm < 0 || opt.algorithm == a; };
+
+        // Los filtros predefinidos usan su instanciacion para 1 o 3 canales
+        // en el interior; el marco sigue la ruta directa.
+        // Si la instanciacion es escalar pero la CPU tiene SIMD, el nucleo
+        // vectorial generico es mas rapido.
+        if (allowed(CONV_STATIC) && kernel.size == 3 && (channels == 1 || channels == 3)) {
+            static_filter = find_static_filter<T>(kernel.name);
+        }
+        if (static_filter && static_filter->isa == CONV_ISA_SCALAR && conv_simd_isa() != CONV_ISA_SCALAR) {
+            static_filter = nullptr;
+        }
+
+        if (static_filter) {
+            algo = CONV_STATIC;
+            isa = conv_isa_name(static_filter->isa);
+            int64_t sum = 0;
+            for (int t = 0; t < 9; t++) {
+                static_taps[t] = static_filter->taps[t];
+                sum += static_taps[t];
+            }
+            static_full = (sum != 0) ? sum : static_filter->divisor;
+        } else if (allowed(CONV_BOX) && kernel_is_box(kernel)) {
+            algo = CONV_BOX;
+            inv_count.resize(kernel.size * kernel.size + 1);
+            inv_count[0] = 0.0;
+            for (size_t i = 1; i < inv_count.size(); i++) inv_count[i] = 1.0 / i;
+        } else if (allowed(CONV_SEPARABLE) && (kernel.size > 3 || opt.algorithm == CONV_SEPARABLE) &&
+                   kernel.size > 1 && kernel_separate(kernel, col, row)) {
+            // En 3x3 el nucleo directo vectorial gana al separable.
+            algo = CONV_SEPARABLE;
+        } else if (kernel.size > 1 && (opt.algorithm == CONV_FFT ||
+                   (opt.algorithm < 0 && kernel.size >= FFT_MIN_KERNEL_SIZE && opt.precision != PRECISION_FIXED))) {
+            // La FFT trabaja en double: con --precision fixed solo si se pide.
+            algo = CONV_FFT;
+            fft.init(kernel.taps.data(), kernel.size, fft_block_size(kernel.radius(), width, height),
+                     tap_sum != 0 ? 1.0 / tap_sum : 1.0);
+        }
+
+        // El box ya suma en enteros; en punto fijo solo cambia a redondear.
+        if (opt.precision == PRECISION_FIXED && sizeof(T) == 1 && algo != CONV_FFT) {
+            fixed = true;
+            if (algo == CONV_SEPARABLE) {
+                float row_sum = 0.0f, col_sum = 0.0f;
+                for (float t : row) row_sum += t;
+                for (float t : col) col_sum += t;
+                bool normalize = (row_sum * col_sum != 0);
+                row_shift = quantize_taps(row.data(), kernel.size, normalize ? row_sum : 0.0f, qrow);
+                col_shift = quantize_taps(col.data(), kernel.size, normalize ? col_sum : 0.0f, qcol);
+                fixed = (row_shift >= 0 && col_shift >= 0);
+            } else if (algo == CONV_DIRECT || algo == CONV_STATIC) {
+                fixed_shift = quantize_taps(kernel.taps.data(), kernel.size * kernel.size, tap_sum, qtaps);
+                fixed = (fixed_shift >= 0);
+                if (fixed && kernel.size == 3 && algo == CONV_DIRECT) {
+                    for (int t = 0; t < 9; t++) fixed3x3.k[t] = (int16_t) qtaps[t];
+                    fixed3x3.shift = fixed_shift;
+                    fixed3x3.max_color = max_color;
+                    row3x3_fixed = conv3x3_fixed_select(fixed_fits_int16(qtaps, fixed_shift), &isa);
+                }
+            }
+        }
+
+        if (algo == CONV_DIRECT && kernel.size == 3 && !fixed) {
+            std::copy(kernel.taps.begin(), kernel.taps.end(), params3x3.k);
+            params3x3.norm = tap_sum;
+            params3x3.divide = (tap_sum != 0);
+            params3x3.bias = opt.round_nearest ? 0.5f : 0.0f;
+            params3x3.max_color = max_color;
+            row3x3 = conv3x3_select<T>(&isa);
+        }
+    }
+
+    ConvAlgorithm algorithm() const { return algo; }
+
+    // Para repartir filas entre hilos: las regiones que empiezan en un
+    // multiplo de este valor no desperdician trabajo y solo leen las filas
+    // [y0 - r, y1 + r) (la FFT procesa bloques de tileSize() filas).
+    int rowAlignment() const { return algo == CONV_FFT ? fft.tileSize() : 1; }
+
+    int radius() const { return kernel.radius(); }
+    BorderMode border() const { return opt.border; }
+
+    // Conjunto de instrucciones del nucleo elegido ("escalar" si no hay).
+    const char* isaName() const { return isa; }
+
+    // "fixed" si se usa punto fijo (pedido y la imagen es de 8 bits).
+    const char* precisionName() const { return fixed ? "fixed" : "float"; }
+
+    // Filtra los pixeles [x0, x1) x [y0, y1) de src (imagen completa). dst
+    // apunta a la primera muestra de la fila y0 (columna 0) y sus filas
+    // estan separadas por dst_pitch muestras.
+    void run(const T* src, int x0, int x1, int y0, int y1, T* dst, size_t dst_pitch) const {
+        if (x0 >= x1 || y0 >= y1) return;
+        switch (algo) {
+            case CONV_BOX: runBox(src, x0, x1, y0, y1, dst, dst_pitch); break;
+            case CONV_SEPARABLE:
+                if (fixed) runSeparableFixed(src, x0, x1, y0, y1, dst, dst_pitch);
+                else runSeparable(src, x0, x1, y0, y1, dst, dst_pitch);
+                break;
+            default:
+                if (kernel.size == 3) runDirect<1>(src, x0, x1, y0, y1, dst, dst_pitch);
+                else runDirect<0>(src, x0, x1, y0, y1, dst, dst_pitch);
+                break;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,522 @@
+#ifndef CONVOLVE_SIMD_H
+#define CONVOLVE_SIMD_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CONV_SIMD_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define CONV_SIMD_NEON 1
+#endif
+
+// Nucleos vectoriales 3x3 para el interior de la imagen (donde los 9 taps
+// caen dentro). Cada funcion procesa 'count' muestras consecutivas de una
+// fila; above/mid/below apuntan a la misma columna en las filas y-1, y, y+1
+// y el vecino horizontal esta a +-ch muestras. Suman los taps en el mismo
+// orden que la ruta escalar y sin FMA, asi que el resultado es identico.
+
+struct Conv3x3Params {
+    float k[9];
+    float norm;       // suma de los 9 pesos
+    bool divide;      // norm != 0
+    float bias;       // 0.5 si se redondea
+    int max_color;
+};
+
+template <typename T>
+struct Conv3x3Row {
+    typedef void (*Fn)(const T* above, const T* mid, const T* below, T* out,
+                       int count, int ch, const Conv3x3Params& p);
+};
+
+
+template <typename T>
+inline void conv3x3_row_scalar(const T* above, const T* mid, const T* below, T* out,
+                               int count, int ch, const Conv3x3Params& p) {
+    const T* rows[3] = {above, mid, below};
+    for (int i = 0; i < count; i++) {
+        float sum = 0.0f;
+        for (int ky = 0; ky < 3; ky++) {
+            sum += rows[ky][i - ch] * p.k[ky * 3 + 0];
+            sum += rows[ky][i] * p.k[ky * 3 + 1];
+            sum += rows[ky][i + ch] * p.k[ky * 3 + 2];
+        }
+        float value = p.divide ? sum / p.norm : sum;
+        int result = static_cast<int>(value + p.bias);
+        out[i] = (T) (result < 0 ? 0 : (result > p.max_color ? p.max_color : result));
+    }
+}
+
+
+// Version en punto fijo para 8 bits: pesos int16 escalados por 2^shift y
+// acumuladores int32, o int16 si sum|k| * 255 cabe (kernels enteros como
+// laplace). Redondea al mas cercano: (acc + 2^shift / 2) >> shift. La suma
+// entera no depende del orden, asi que todas las variantes dan lo mismo.
+struct Conv3x3FixedParams {
+    int16_t k[9];
+    int shift;
+    int max_color;
+};
+
+typedef void (*Conv3x3FixedFn)(const uint8_t* above, const uint8_t* mid, const uint8_t* below,
+                               uint8_t* out, int count, int ch, const Conv3x3FixedParams& p);
+
+inline void conv3x3_fixed_row_scalar(const uint8_t* above, const uint8_t* mid, const uint8_t* below,
+                                     uint8_t* out, int count, int ch, const Conv3x3FixedParams& p) {
+    const uint8_t* rows[3] = {above, mid, below};
+    const int32_t half = (1 << p.shift) >> 1;
+    for (int i = 0; i < count; i++) {
+        int32_t acc = half;
+        for (int ky = 0; ky < 3; ky++) {
+            acc += rows[ky][i - ch] * p.k[ky * 3 + 0];
+            acc += rows[ky][i] * p.k[ky * 3 + 1];
+            acc += rows[ky][i + ch] * p.k[ky * 3 + 2];
+        }
+        int result = acc >> p.shift;
+        out[i] = (uint8_t) (result < 0 ? 0 : (result > p.max_color ? p.max_color : result));
+    }
+}
+
+
+#if defined(CONV_SIMD_X86)
+
+__attribute__((target("avx2")))
+inline __m256 conv_load8_avx2(const uint8_t* p) {
+    return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) p)));
+}
+
+__attribute__((target("avx2")))
+inline __m256 conv_load8_avx2(const uint16_t* p) {
+    return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*) p)));
+}
+
+__attribute__((target("avx2")))
+inline void conv_store8_avx2(uint8_t* p, __m256i v) {
+    __m128i lo = _mm256_castsi256_si128(v), hi = _mm256_extracti128_si256(v, 1);
+    __m128i w16 = _mm_packus_epi32(lo, hi);
+    _mm_storel_epi64((__m128i*) p, _mm_packus_epi16(w16, w16));
+}
+
+__attribute__((target("avx2")))
+inline void conv_store8_avx2(uint16_t* p, __m256i v) {
+    __m128i lo = _mm256_castsi256_si128(v), hi = _mm256_extracti128_si256(v, 1);
+    _mm_storeu_si128((__m128i*) p, _mm_packus_epi32(lo, hi));
+}
+
+// 8 muestras por vector, dos vectores (16 muestras) por iteracion.
+template <typename T>
+__attribute__((target("avx2")))
+void conv3x3_row_avx2(const T* above, const T* mid, const T* below, T* out,
+                      int count, int ch, const Conv3x3Params& p) {
+    const T* rows[3] = {above, mid, below};
+    __m256 k[9];
+    for (int t = 0; t < 9; t++) k[t] = _mm256_set1_ps(p.k[t]);
+    const __m256 norm = _mm256_set1_ps(p.norm);
+    const __m256 bias = _mm256_set1_ps(p.bias);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i maxc = _mm256_set1_epi32(p.max_color);
+
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+        for (int ky = 0; ky < 3; ky++) {
+            const T* r = rows[ky] + i;
+            for (int kx = 0; kx < 3; kx++) {
+                const T* q = r + (kx - 1) * ch;
+                s0 = _mm256_add_ps(s0, _mm256_mul_ps(conv_load8_avx2(q), k[ky * 3 + kx]));
+                s1 = _mm256_add_ps(s1, _mm256_mul_ps(conv_load8_avx2(q + 8), k[ky * 3 + kx]));
+            }
+        }
+        if (p.divide) {
+            s0 = _mm256_div_ps(s0, norm);
+            s1 = _mm256_div_ps(s1, norm);
+        }
+        __m256i v0 = _mm256_cvttps_epi32(_mm256_add_ps(s0, bias));
+        __m256i v1 = _mm256_cvttps_epi32(_mm256_add_ps(s1, bias));
+        v0 = _mm256_min_epi32(_mm256_max_epi32(v0, zero), maxc);
+        v1 = _mm256_min_epi32(_mm256_max_epi32(v1, zero), maxc);
+        conv_store8_avx2(out + i, v0);
+        conv_store8_avx2(out + i + 8, v1);
+    }
+    for (; i + 8 <= count; i += 8) {
+        __m256 s = _mm256_setzero_ps();
+        for (int ky = 0; ky < 3; ky++) {
+            for (int kx = 0; kx < 3; kx++) {
+                s = _mm256_add_ps(s, _mm256_mul_ps(conv_load8_avx2(rows[ky] + i + (kx - 1) * ch), k[ky * 3 + kx]));
+            }
+        }
+        if (p.divide) s = _mm256_div_ps(s, norm);
+        __m256i v = _mm256_cvttps_epi32(_mm256_add_ps(s, bias));
+        conv_store8_avx2(out + i, _mm256_min_epi32(_mm256_max_epi32(v, zero), maxc));
+    }
+    conv3x3_row_scalar(above + i, mid + i, below + i, out + i, count - i, ch, p);
+}
+
+
+// Punto fijo: los taps van en pares (a, b) para _mm256_madd_epi16, que
+// multiplica en 16 bits y suma cada par en 32. unpacklo/hi y packs trabajan
+// por carriles de 128 bits, asi que el orden de las muestras se recupera al
+// empaquetar.
+__attribute__((target("avx2")))
+inline __m256i conv_load16_fixed_avx2(const uint8_t* p) {
+    return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) p));
+}
+
+__attribute__((target("avx2")))
+inline void conv3x3_fixed_row_avx2(const uint8_t* above, const uint8_t* mid, const uint8_t* below,
+                                   uint8_t* out, int count, int ch, const Conv3x3FixedParams& p) {
+    const uint8_t* rows[3] = {above, mid, below};
+    __m256i kpair[5];
+    for (int t = 0; t < 9; t += 2) {
+        int16_t b = (t + 1 < 9) ? p.k[t + 1] : 0;
+        kpair[t / 2] = _mm256_set1_epi32((int32_t) (uint16_t) p.k[t] | ((int32_t) b << 16));
+    }
+    const __m256i half = _mm256_set1_epi32((1 << p.shift) >> 1);
+    const __m128i shift = _mm_cvtsi32_si128(p.shift);
+    const __m256i maxc = _mm256_set1_epi16((int16_t) p.max_color);
+
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i lo = half, hi = half;
+        for (int t = 0; t < 9; t += 2) {
+            __m256i a = conv_load16_fixed_avx2(rows[t / 3] + i + (t % 3 - 1) * ch);
+            __m256i b = (t + 1 < 9)
+                ? conv_load16_fixed_avx2(rows[(t + 1) / 3] + i + ((t + 1) % 3 - 1) * ch)
+                : _mm256_setzero_si256();
+            lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), kpair[t / 2]));
+            hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), kpair[t / 2]));
+        }
+        lo = _mm256_sra_epi32(lo, shift);
+        hi = _mm256_sra_epi32(hi, shift);
+        __m256i v = _mm256_min_epi16(_mm256_packs_epi32(lo, hi), maxc);
+        __m256i bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(v, v), 0x08);
+        _mm_storeu_si128((__m128i*) (out + i), _mm256_castsi256_si128(bytes));
+    }
+    conv3x3_fixed_row_scalar(above + i, mid + i, below + i, out + i, count - i, ch, p);
+}
+
+
+// Acumulador int16: 16 muestras por vector con mullo/add de 16 bits, dos
+// vectores (32 muestras) por iteracion.
+__attribute__((target("avx2")))
+inline void conv3x3_fixed16_row_avx2(const uint8_t* above, const uint8_t* mid, const uint8_t* below,
+                                     uint8_t* out, int count, int ch, const Conv3x3FixedParams& p) {
+    const uint8_t* rows[3] = {above, mid, below};
+    __m256i k[9];
+    for (int t = 0; t < 9; t++) k[t] = _mm256_set1_epi16(p.k[t]);
+    const __m256i half = _mm256_set1_epi16((int16_t) ((1 << p.shift) >> 1));
+    const __m128i shift = _mm_cvtsi32_si128(p.shift);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i maxc = _mm256_set1_epi16((int16_t) p.max_color);
+
+    int i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i acc0 = half, acc1 = half;
+        for (int ky = 0; ky < 3; ky++) {
+            for (int kx = 0; kx < 3; kx++) {
+                const uint8_t* q = rows[ky] + i + (kx - 1) * ch;
+                acc0 = _mm256_add_epi16(acc0, _mm256_mullo_epi16(conv_load16_fixed_avx2(q), k[ky * 3 + kx]));
+                acc1 = _mm256_add_epi16(acc1, _mm256_mullo_epi16(conv_load16_fixed_avx2(q + 16), k[ky * 3 + kx]));
+            }
+        }
+        acc0 = _mm256_min_epi16(_mm256_max_epi16(_mm256_sra_epi16(acc0, shift), zero), maxc);
+        acc1 = _mm256_min_epi16(_mm256_max_epi16(_mm256_sra_epi16(acc1, shift), zero), maxc);
+        __m256i bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(acc0, acc1), 0xD8);
+        _mm256_storeu_si256((__m256i*) (out + i), bytes);
+    }
+    for (; i + 16 <= count; i += 16) {
+        __m256i acc = half;
+        for (int ky = 0; ky < 3; ky++) {
+            for (int kx = 0; kx < 3; kx++) {
+                __m256i v = conv_load16_fixed_avx2(rows[ky] + i + (kx - 1) * ch);
+                acc = _mm256_add_epi16(acc, _mm256_mullo_epi16(v, k[ky * 3 + kx]));
+            }
+        }
+        acc = _mm256_min_epi16(_mm256_max_epi16(_mm256_sra_epi16(acc, shift), zero), maxc);
+        __m256i bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(acc, acc), 0x08);
+        _mm_storeu_si128((__m128i*) (out + i), _mm256_castsi256_si128(bytes));
+    }
+    conv3x3_fixed_row_scalar(above + i, mid + i, below + i, out + i, count - i, ch, p);
+}
+
+__attribute__((target("sse4.1")))
+inline __m128 conv_load4_sse41(const uint8_t* p) {
+    int32_t bits;
+    memcpy(&bits, p, 4);
+    return _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(bits)));
+}
+
+__attribute__((target("sse4.1")))
+inline __m128 conv_load4_sse41(const uint16_t* p) {
+    return _mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*) p)));
+}
+
+__attribute__((target("sse4.1")))
+inline void conv_store4_sse41(uint8_t* p, __m128i v) {
+    __m128i w16 = _mm_packus_epi32(v, v);
+    int32_t bits = _mm_cvtsi128_si32(_mm_packus_epi16(w16, w16));
+    memcpy(p, &bits, 4);
+}
+
+__attribute__((target("sse4.1")))
+inline void conv_store4_sse41(uint16_t* p, __m128i v) {
+    _mm_storel_epi64((__m128i*) p, _mm_packus_epi32(v, v));
+}
+
+// 4 muestras por vector.
+template <typename T>
+__attribute__((target("sse4.1")))
+void conv3x3_row_sse41(const T* above, const T* mid, const T* below, T* out,
+                       int count, int ch, const Conv3x3Params& p) {
+    const T* rows[3] = {above, mid, below};
+    __m128 k[9];
+    for (int t = 0; t < 9; t++) k[t] = _mm_set1_ps(p.k[t]);
+    const __m128 norm = _mm_set1_ps(p.norm);
+    const __m128 bias = _mm_set1_ps(p.bias);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i maxc = _mm_set1_epi32(p.max_color);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 s = _mm_setzero_ps();
+        for (int ky = 0; ky < 3; ky++) {
+            for (int kx = 0; kx < 3; kx++) {
+                s = _mm_add_ps(s, _mm_mul_ps(conv_load4_sse41(rows[ky] + i + (kx - 1) * ch), k[ky * 3 + kx]));
+            }
+        }
+        if (p.divide) s = _mm_div_ps(s, norm);
+        __m128i v = _mm_cvttps_epi32(_mm_add_ps(s, bias));
+        conv_store4_sse41(out + i, _mm_min_epi32(_mm_max_epi32(v, zero), maxc));
+    }
+    conv3x3_row_scalar(above + i, mid + i, below + i, out + i, count - i, ch, p);
+}
+
+__attribute__((target("sse4.1")))
+inline __m128i conv_load8_fixed_sse41(const uint8_t* p) {
+    return _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*) p));
+}
+
+__attribute__((target("sse4.1")))
+inline void conv3x3_fixed_row_sse41(const uint8_t* above, const uint8_t* mid, const uint8_t* below,
+                                    uint8_t* out, int count, int ch, const Conv3x3FixedParams& p) {
+    const uint8_t* rows[3] = {above, mid, below};
+    __m128i kpair[5];
+    for (int t = 0; t < 9; t += 2) {
+        int16_t b = (t + 1 < 9) ? p.k[t + 1] : 0;
+        kpair[t / 2] = _mm_set1_epi32((int32_t) (uint16_t) p.k[t] | ((int32_t) b << 16));
+    }
+    const __m128i half = _mm_set1_epi32((1 << p.shift) >> 1);
+    const __m128i shift = _mm_cvtsi32_si128(p.shift);
+    const __m128i maxc = _mm_set1_epi16((int16_t) p.max_color);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i lo = half, hi = half;
+        for (int t = 0; t < 9; t += 2) {
+            __m128i a = conv_load8_fixed_sse41(rows[t / 3] + i + (t % 3 - 1) * ch);
+            __m128i b = (t + 1 < 9)
+                ? conv_load8_fixed_sse41(rows[(t + 1) / 3] + i + ((t + 1) % 3 - 1) * ch)
+                : _mm_setzero_si128();
+            lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), kpair[t / 2]));
+            hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), kpair[t / 2]));
+        }
+        __m128i v = _mm_packs_epi32(_mm_sra_epi32(lo, shift), _mm_sra_epi32(hi, shift));
+        v = _mm_min_epi16(v, maxc);
+        _mm_storel_epi64((__m128i*) (out + i), _mm_packus_epi16(v, v));
+    }
+    conv3x3_fixed_row_scalar(above + i, mid + i, below + i, out + i, count - i, ch, p);
+}
+
+__attribute__((target("sse4.1")))
+inline void conv3x3_fixed16_row_sse41(const uint8_t* above, const uint8_t* mid, const uint8_t* below,
+                                      uint8_t* out, int count, int ch, const Conv3x3FixedParams& p) {
+    const uint8_t* rows[3] = {above, mid, below};
+    __m128i k[9];
+    for (int t = 0; t < 9; t++) k[t] = _mm_set1_epi16(p.k[t]);
+    const __m128i half = _mm_set1_epi16((int16_t) ((1 << p.shift) >> 1));
+    const __m128i shift = _mm_cvtsi32_si128(p.shift);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i maxc = _mm_set1_epi16((int16_t) p.max_color);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i acc = half;
+        for (int ky = 0; ky < 3; ky++) {
+            for (int kx = 0; kx < 3; kx++) {
+                __m128i v = conv_load8_fixed_sse41(rows[ky] + i + (kx - 1) * ch);
+                acc = _mm_add_epi16(acc, _mm_mullo_epi16(v, k[ky * 3 + kx]));
+            }
+        }
+        acc = _mm_min_epi16(_mm_max_epi16(_mm_sra_epi16(acc, shift), zero), maxc);
+        _mm_storel_epi64((__m128i*) (out + i), _mm_packus_epi16(acc, acc));
+    }
+    conv3x3_fixed_row_scalar(above + i, mid + i, below + i, out + i, count - i, ch, p);
+}
+
+#endif  // CONV_SIMD_X86
+
+
+#if defined(CONV_SIMD_NEON)
+
+inline float32x4_t conv_load4_neon(const uint8_t* p) {
+    uint32_t bits;
+    memcpy(&bits, p, 4);
+    uint8x8_t b = vreinterpret_u8_u32(vdup_n_u32(bits));
+    return vcvtq_f32_u32(vmovl_u16(vget_low_u16(vmovl_u8(b))));
+}
+
+inline float32x4_t conv_load4_neon(const uint16_t* p) {
+    return vcvtq_f32_u32(vmovl_u16(vld1_u16(p)));
+}
+
+inline void conv_store4_neon(uint8_t* p, int32x4_t v) {
+    uint16x4_t w16 = vqmovun_s32(v);
+    uint8x8_t b = vqmovn_u16(vcombine_u16(w16, w16));
+    uint32_t bits = vget_lane_u32(vreinterpret_u32_u8(b), 0);
+    memcpy(p, &bits, 4);
+}
+
+inline void conv_store4_neon(uint16_t* p, int32x4_t v) {
+    vst1_u16(p, vqmovun_s32(v));
+}
+
+// En aarch64 GCC puede fusionar mul+add en FMA tanto aqui como en la ruta
+// escalar; para resultados identicos compilar con -ffp-contract=off.
+template <typename T>
+void conv3x3_row_neon(const T* above, const T* mid, const T* below, T* out,
+                      int count, int ch, const Conv3x3Params& p) {
+    const T* rows[3] = {above, mid, below};
+    const float32x4_t bias = vdupq_n_f32(p.bias);
+    const float32x4_t norm = vdupq_n_f32(p.norm);
+    const int32x4_t zero = vdupq_n_s32(0);
+    const int32x4_t maxc = vdupq_n_s32(p.max_color);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        float32x4_t s = vdupq_n_f32(0.0f);
+        for (int ky = 0; ky < 3; ky++) {
+            for (int kx = 0; kx < 3; kx++) {
+                // vmulq + vaddq (no vfmaq) para igualar a la ruta escalar.
+                s = vaddq_f32(s, vmulq_n_f32(conv_load4_neon(rows[ky] + i + (kx - 1) * ch), p.k[ky * 3 + kx]));
+            }
+        }
+        if (p.divide) s = vdivq_f32(s, norm);
+        int32x4_t v = vcvtq_s32_f32(vaddq_f32(s, bias));
+        conv_store4_neon(out + i, vminq_s32(vmaxq_s32(v, zero), maxc));
+    }
+    conv3x3_row_scalar(above + i, mid + i, below + i, out + i, count - i, ch, p);
+}
+
+inline void conv3x3_fixed_row_neon(const uint8_t* above, const uint8_t* mid, const uint8_t* below,
+                                   uint8_t* out, int count, int ch, const Conv3x3FixedParams& p) {
+    const uint8_t* rows[3] = {above, mid, below};
+    const int32x4_t half = vdupq_n_s32((1 << p.shift) >> 1);
+    const int32x4_t shift = vdupq_n_s32(-p.shift);
+    const int16x8_t maxc = vdupq_n_s16((int16_t) p.max_color);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        int32x4_t lo = half, hi = half;
+        for (int t = 0; t < 9; t++) {
+            int16x8_t v = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(rows[t / 3] + i + (t % 3 - 1) * ch)));
+            lo = vmlal_n_s16(lo, vget_low_s16(v), p.k[t]);
+            hi = vmlal_n_s16(hi, vget_high_s16(v), p.k[t]);
+        }
+        int16x8_t v = vcombine_s16(vqmovn_s32(vshlq_s32(lo, shift)), vqmovn_s32(vshlq_s32(hi, shift)));
+        vst1_u8(out + i, vqmovun_s16(vminq_s16(v, maxc)));
+    }
+    conv3x3_fixed_row_scalar(above + i, mid + i, below + i, out + i, count - i, ch, p);
+}
+
+inline void conv3x3_fixed16_row_neon(const uint8_t* above, const uint8_t* mid, const uint8_t* below,
+                                     uint8_t* out, int count, int ch, const Conv3x3FixedParams& p) {
+    const uint8_t* rows[3] = {above, mid, below};
+    const int16x8_t half = vdupq_n_s16((int16_t) ((1 << p.shift) >> 1));
+    const int16x8_t shift = vdupq_n_s16((int16_t) -p.shift);
+    const int16x8_t maxc = vdupq_n_s16((int16_t) p.max_color);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t acc = half;
+        for (int t = 0; t < 9; t++) {
+            int16x8_t v = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(rows[t / 3] + i + (t % 3 - 1) * ch)));
+            acc = vmlaq_n_s16(acc, v, p.k[t]);
+        }
+        vst1_u8(out + i, vqmovun_s16(vminq_s16(vshlq_s16(acc, shift), maxc)));
+    }
+    conv3x3_fixed_row_scalar(above + i, mid + i, below + i, out + i, count - i, ch, p);
+}
+
+#endif  // CONV_SIMD_NEON
+
+
+enum ConvIsa {
+    CONV_ISA_SCALAR,
+    CONV_ISA_SSE41,
+    CONV_ISA_AVX2,
+    CONV_ISA_NEON
+};
+
+inline const char* conv_isa_name(ConvIsa isa) {
+    switch (isa) {
+        case CONV_ISA_SSE41: return "sse4.1";
+        case CONV_ISA_AVX2: return "avx2";
+        case CONV_ISA_NEON: return "neon";
+        default: return "escalar";
+    }
+}
+
+// La mejor variante que soporta la CPU en ejecucion. La variable de entorno
+// PNM_SIMD=scalar|sse41|avx2|neon fuerza una (util para comparar).
+inline ConvIsa conv_simd_isa() {
+    const char* forced = getenv("PNM_SIMD");
+    bool allow_any = (forced == nullptr || forced[0] == '\0');
+
+#if defined(CONV_SIMD_X86)
+    __builtin_cpu_init();
+    if ((allow_any || strcmp(forced, "avx2") == 0) && __builtin_cpu_supports("avx2")) return CONV_ISA_AVX2;
+    if ((allow_any || strcmp(forced, "sse41") == 0) && __builtin_cpu_supports("sse4.1")) return CONV_ISA_SSE41;
+#elif defined(CONV_SIMD_NEON)
+    if (allow_any || strcmp(forced, "neon") == 0) return CONV_ISA_NEON;
+#endif
+    (void) allow_any;
+    return CONV_ISA_SCALAR;
+}
+
+
+template <typename T>
+typename Conv3x3Row<T>::Fn conv3x3_select(const char** isa_name) {
+    ConvIsa isa = conv_simd_isa();
+    *isa_name = conv_isa_name(isa);
+    switch (isa) {
+#if defined(CONV_SIMD_X86)
+        case CONV_ISA_AVX2: return conv3x3_row_avx2<T>;
+        case CONV_ISA_SSE41: return conv3x3_row_sse41<T>;
+#elif defined(CONV_SIMD_NEON)
+        case CONV_ISA_NEON: return conv3x3_row_neon<T>;
+#endif
+        default: return conv3x3_row_scalar<T>;
+    }
+}
+
+
+// narrow: los pesos permiten acumular en int16 (ver fixed_fits_int16).
+inline Conv3x3FixedFn conv3x3_fixed_select(bool narrow, const char** isa_name) {
+    ConvIsa isa = conv_simd_isa();
+    *isa_name = conv_isa_name(isa);
+    switch (isa) {
+#if defined(CONV_SIMD_X86)
+        case CONV_ISA_AVX2: return narrow ? conv3x3_fixed16_row_avx2 : conv3x3_fixed_row_avx2;
+        case CONV_ISA_SSE41: return narrow ? conv3x3_fixed16_row_sse41 : conv3x3_fixed_row_sse41;
+#elif defined(CONV_SIMD_NEON)
+        case CONV_ISA_NEON: return narrow ? conv3x3_fixed16_row_neon : conv3x3_fixed_row_neon;
+#endif
+        default: return conv3x3_fixed_row_scalar;
+    }
+}
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef FFT_CONV_H
+#define FFT_CONV_H
+
+#include <cmath>
+#include <complex>
+#include <vector>
+
+// Convolucion por FFT para kernels grandes no separables. La imagen se
+// recorre en bloques de F x F (F potencia de 2) con solapamiento de r
+// pixeles por lado (overlap-save); cada bloque aporta (F - 2r)^2 pixeles.
+// Como el kernel es real, dos bloques viajan juntos en una sola FFT
+// compleja: uno en la parte real y otro en la imaginaria.
+
+typedef std::complex<double> FFTComplex;
+
+// FFT radix-2 iterativa de tamano n fijo.
+class FFT1D {
+private:
+    int n;
+    std::vector<int> rev;
+    std::vector<FFTComplex> twiddle;
+
+public:
+    FFT1D() : n(0) {}
+
+    void init(int n_) {
+        n = n_;
+        int bits = 0;
+        while ((1 << bits) < n) bits++;
+        rev.resize(n);
+        for (int i = 0; i < n; i++) {
+            int r = 0;
+            for (int b = 0; b < bits; b++) {
+                if (i & (1 << b)) r |= 1 << (bits - 1 - b);
+            }
+            rev[i] = r;
+        }
+        twiddle.resize(n / 2);
+        for (int i = 0; i < n / 2; i++) twiddle[i] = std::polar(1.0, -2.0 * M_PI * i / n);
+    }
+
+    // Transformada en sitio de a[0..n) (la inversa no divide por n).
+    void transform(FFTComplex* a, bool inverse) const {
+        for (int i = 0; i < n; i++) {
+            if (i < rev[i]) std::swap(a[i], a[rev[i]]);
+        }
+        for (int len = 2; len <= n; len <<= 1) {
+            int half = len / 2, step = n / len;
+            for (int i = 0; i < n; i += len) {
+                for (int j = 0; j < half; j++) {
+                    FFTComplex w = inverse ? std::conj(twiddle[j * step]) : twiddle[j * step];
+                    FFTComplex u = a[i + j], v = a[i + j + half] * w;
+                    a[i + j] = u + v;
+                    a[i + j + half] = u - v;
+                }
+            }
+        }
+    }
+};
+
+
+class FFTConvolver {
+private:
+    int size;      // F
+    int radius;
+    FFT1D fft;
+    std::vector<FFTComplex> spectrum;   // FFT del kernel reflejado, ya escalado
+
+    // 2D: filas y luego columnas (copiadas a un buffer contiguo).
+    void transform2D(FFTComplex* a, bool inverse) const {
+        for (int y = 0; y < size; y++) fft.transform(a + (size_t) y * size, inverse);
+        std::vector<FFTComplex> column(size);
+        for (int x = 0; x < size; x++) {
+            for (int y = 0; y < size; y++) column[y] = a[(size_t) y * size + x];
+            fft.transform(column.data(), inverse);
+            for (int y = 0; y < size; y++) a[(size_t) y * size + x] = column[y];
+        }
+    }
+
+public:
+    FFTConvolver() : size(0), radius(0) {}
+
+    // taps: kernel ksize x ksize por filas. scale multiplica el resultado
+    // (1/norm); el 1/F^2 de la inversa se aplica aqui.
+    void init(const float* taps, int ksize, int fft_size, double scale) {
+        size = fft_size;
+        radius = ksize / 2;
+        fft.init(size);
+        spectrum.assign((size_t) size * size, FFTComplex(0.0, 0.0));
+
+        // out(y, x) = sum k(ky, kx) * in(y + ky, x + kx) es una correlacion:
+        // el kernel va reflejado, h[-ky][-kx] = k(ky, kx), modulo F.
+        double s = scale / ((double) size * size);
+        for (int ky = -radius; ky <= radius; ky++) {
+            for (int kx = -radius; kx <= radius; kx++) {
+                int u = (size - ky) % size, v = (size - kx) % size;
+                spectrum[(size_t) u * size + v] = taps[(ky + radius) * ksize + (kx + radius)] * s;
+            }
+        }
+        transform2D(spectrum.data(), false);
+    }
+
+    int fftSize() const { return size; }
+
+    // Pixeles utiles por lado de cada bloque.
+    int tileSize() const { return size - 2 * radius; }
+
+    // buf (F x F): bloque A en la parte real y B en la imaginaria, con el
+    // pixel (0, 0) del bloque en la esquina superior izquierda del area de
+    // entrada. Al volver, el resultado del pixel (r + j, r + i) de cada
+    // bloque esta en la misma posicion.
+    void convolvePair(FFTComplex* buf) const {
+        transform2D(buf, false);
+        for (size_t i = 0; i < spectrum.size(); i++) buf[i] *= spectrum[i];
+        transform2D(buf, true);
+    }
+};
+
+#endif
@@ -2,205 +2,87 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <cstdint>
 #include <algorithm>
-#include <ctime>   
+#include <chrono>
+#include "pnmfilter.h"
+#include "options.h"
+#include "batch.h"
+#include "pnm_stream.h"
 using namespace std;
 
-class PNMImage {
-private:
-    char magic[3];
-    int width;
-    int height;
-    int max_color;
-    int* pixels;
-    int pixel_count;
-
-    void applyKernel(const float kernel[3][3]) {
-        int* result_pixels = (int*) malloc(pixel_count * sizeof(int));
-        if (!result_pixels) {
-            cerr << "Error reservando memoria para el filtro" << endl;
-            return;
-        }
-
-        int channels = (strcmp(magic, "P3") == 0) ? 3 : 1;
-
-        for (int y = 0; y < height; y++) {
-            for (int x = 0; x < width; x++) {
-                for (int c = 0; c < channels; c++) {
-                    float sum = 0.0;
-                    float weight_sum = 0.0;
-
-                    for (int ky = -1; ky <= 1; ky++) {
-                        for (int kx = -1; kx <= 1; kx++) {
-                            int nx = x + kx;
-                            int ny = y + ky;
-
-                            if (nx >= 0 && nx < width && ny >= 0 && ny < height) {
-                                int idx = (ny * width + nx) * channels + c;
-                                sum += pixels[idx] * kernel[ky+1][kx+1];
-                                weight_sum += kernel[ky+1][kx+1];
-                            }
-                        }
-                    }
-
-                    float value = (weight_sum != 0) ? sum / weight_sum : sum;
-                    int result = static_cast<int>(value);
-
-                    result = max(0, min(max_color, result));
-
-                    int idx = (y * width + x) * channels + c;
-                    result_pixels[idx] = result;
-                }
-            }
-        }
-
-        free(pixels);
-        pixels = result_pixels;
-    }
-
-public:
-    PNMImage() : width(0), height(0), max_color(0), pixels(nullptr), pixel_count(0) {
-        magic[0] = '\0';
-    }
+template <typename T>
+bool applyKernel(PNMImage<T>& img, const Kernel& kernel, const FilterOptions& opt) {
+    ConvPlan<T> plan(kernel, img.getWidth(), img.getHeight(), img.getChannels(), img.getMaxColor(),
+                     opt.convOptions());
+    cout << "Algoritmo de convolucion: " << conv_algorithm_name(plan.algorithm())
+         << " (" << plan.isaName() << ", " << plan.precisionName() << ")" << endl;
+    if (opt.backend != BACKEND_SERIAL) cout << "Backend: " << backend_name(opt.backend) << endl;
+    return filter_image(img, plan, opt.backend, opt.threads);
+}
 
-    ~PNMImage() {
-        if (pixels) free(pixels);
+template <typename T>
+int run(const char* input, const char* output, const FilterOptions& opt) {
+    // --stream: ventana de filas en vez de la imagen entera en memoria.
+    if (opt.stream) {
+        Kernel kernel;
+        if (!load_filter_kernel(opt.filter, opt, kernel)) return 1;
+        if (!filter_stream<T>(input, output, kernel, opt.convOptions())) return 1;
+        cout << "Imagen procesada con filtro " << opt.filterName()
+             << " y guardada en " << output << endl;
+        return 0;
     }
 
-    bool load(const char* filename) {
-        FILE* file = fopen(filename, "r");
-        if (!file) {
-            cerr << "Error: no se pudo abrir " << filename << endl;
-            return false;
-        }
-
-        if (fscanf(file, "%2s", magic) != 1) {
-            cerr << "Error leyendo magic number" << endl;
-            fclose(file);
-            return false;
-        }
-
-        if (fscanf(file, "%d %d", &width, &height) != 2) {
-            cerr << "Error leyendo width/height" << endl;
-            fclose(file);
-            return false;
-        }
-
-        if (fscanf(file, "%d", &max_color) != 1) {
-            cerr << "Error leyendo max_color" << endl;
-            fclose(file);
-            return false;
-        }
-
-        pixel_count = width * height;
-        if (strcmp(magic, "P3") == 0) {
-            pixel_count *= 3;
-        }
-
-        pixels = (int*) malloc(pixel_count * sizeof(int));
-        if (!pixels) {
-            cerr << "Error reservando memoria" << endl;
-            fclose(file);
-            return false;
-        }
-
-        for (int i = 0; i < pixel_count; i++) {
-            if (fscanf(file, "%d", &pixels[i]) != 1) {
-                cerr << "Error leyendo píxeles" << endl;
-                free(pixels);
-                pixels = nullptr;
-                fclose(file);
-                return false;
-            }
-        }
-
-        fclose(file);
-        return true;
-    }
+    PNMImage<T> img;
+    if (!img.load(input)) return 1;
+    pnm_report_read(img.getReadStats());
 
-    bool save(const char* filename) const {
-        FILE* out = fopen(filename, "w");
-        if (!out) {
-            cerr << "Error: no se pudo abrir " << filename << " para escritura" << endl;
-            return false;
-        }
+    Kernel kernel;
+    if (!load_filter_kernel(opt.filter, opt, kernel)) return 1;
 
-        fprintf(out, "%s\n%d %d\n%d\n", magic, width, height, max_color);
+    // Tiempo real: clock() suma la CPU de todos los hilos de --backend.
+    auto start_time = chrono::steady_clock::now();
 
-        for (int i = 0; i < pixel_count; i++) {
-            fprintf(out, "%d ", pixels[i]);
-            if ((i+1) % 12 == 0) fprintf(out, "\n");
-        }
+    if (!applyKernel(img, kernel, opt)) return 1;
 
-        fclose(out);
-        return true;
-    }
+    double wall_time = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+    cout << "Tiempo real del filtrado: " << wall_time << " segundos" << endl;
 
-    void applyBlur() {
-        const float kernel[3][3] = {
-            {1.0/9, 1.0/9, 1.0/9},
-            {1.0/9, 1.0/9, 1.0/9},
-            {1.0/9, 1.0/9, 1.0/9}
-        };
-        applyKernel(kernel);
-    }
+    if (!img.save(output)) return 1;
 
-    void applyLaplace() {
-        const float kernel[3][3] = {
-            {0, -1, 0},
-            {-1, 4, -1},
-            {0, -1, 0}
-        };
-        applyKernel(kernel);
-    }
+    cout << "Imagen procesada con filtro " << opt.filterName()
+         << " y guardada en " << output << endl;
 
-    void applySharpen() {
-        const float kernel[3][3] = {
-            {0, -1, 0},
-            {-1, 5, -1},
-            {0, -1, 0}
-        };
-        applyKernel(kernel);
-    }
-};
+    return 0;
+}
 
 int main(int argc, char* argv[]) {
-    if (argc < 5) {
-        cout << "Uso: " << argv[0] << " <input_image> <output_image> --f <filtro>\n";
-        cout << "Filtros disponibles: blur, laplace, sharpen\n";
-        return 1;
-    }
-
-    PNMImage img;
-    if (!img.load(argv[1])) return 1;
+    // Modo lote: las banderas empiezan en argv[1].
+    if (argc > 1 && strncmp(argv[1], "--", 2) == 0) return batch_main(argc, argv, false);
 
-    if (strcmp(argv[3], "--f") != 0) {
-        cerr << "Error: se esperaba la bandera --f\n";
+    if (argc < 5) {
+        cout << "Uso: " << argv[0] << " <input_image> <output_image> --f <filtro>|--kernel <fichero> [--radius N] [--border modo] [--precision fixed|float] [--algo auto|direct|separable|fft] [--backend serial|openmp|threads|mpi] [--threads N] [--stream] [--profile] [--profile-json fichero]\n";
+        cout << "Bordes: renormalize (por defecto), clamp, mirror, wrap, zero\n";
+        cout << "Filtros disponibles: blur, gaussian, laplace, sharpen, sobel, emboss\n";
+        cout << "Lote: " << argv[0] << " --input-dir dir|--list fichero --output-dir dir --f <filtro>|--kernel <fichero> [--glob patron] [--readers N] [--writers N] [--memory-mb N] [opciones]\n";
         return 1;
     }
 
-    clock_t start_time = clock();
-
-    if (strcmp(argv[4], "blur") == 0) {
-        img.applyBlur();
-    } else if (strcmp(argv[4], "laplace") == 0) {
-        img.applyLaplace();
-    } else if (strcmp(argv[4], "sharpen") == 0) {
-        img.applySharpen();
-    } else {
-        cerr << "Filtro no reconocido: " << argv[4] << endl;
+    if (strcmp(argv[3], "--f") != 0 && strcmp(argv[3], "--kernel") != 0) {
+        cerr << "Error: se esperaba la bandera --f o --kernel\n";
         return 1;
     }
 
-    clock_t end_time = clock();
-
-    double cpu_time = double(end_time - start_time) / CLOCKS_PER_SEC;
-    cout << "Tiempo de CPU usado en el filtrado: " << cpu_time << " segundos" << endl;
+    FilterOptions opt;
+    if (!parse_filter_options(argc, argv, 3, opt)) return 1;
+    if (opt.profile) profiler().enable();
 
-    if (!img.save(argv[2])) return 1;
+    // Con --stream la imagen no se guarda entera: no aplica el limite de
+    // 2^31 muestras.
+    PNMHeader header;
+    if (!pnm_peek_header(argv[1], header, !opt.stream)) return 1;
 
-    cout << "Imagen procesada con filtro " << argv[4]
-         << " y guardada en " << argv[2] << endl;
-
-    return 0;
+    int status = (header.max_color > 255) ? run<uint16_t>(argv[1], argv[2], opt) : run<uint8_t>(argv[1], argv[2], opt);
+    profile_finish(argv[0], opt.profile_json);
+    return status;
 }
@@ -1,107 +1,646 @@
 #include <mpi.h>
+#include <omp.h>
 #include <iostream>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <algorithm>
+#include <cstdint>
 #include <ctime>
+#include <string>
+#include <vector>
+#include "pnmfilter.h"
+#include "options.h"
+#include "row_strips.h"
 
 using namespace std;
 
 
-bool load_pnm(const char* filename, char magic[3], int &width, int &height, int &max_color, int* &pixels, int &pixel_count) {
-    FILE* f = fopen(filename, "r");
-    if (!f) { cerr << "Error abriendo " << filename << "\n"; return false; }
-    if (fscanf(f, "%2s", magic) != 1) { fclose(f); return false; }
+template <typename T> MPI_Datatype mpi_sample_type();
+template <> MPI_Datatype mpi_sample_type<uint8_t>() { return MPI_UNSIGNED_CHAR; }
+template <> MPI_Datatype mpi_sample_type<uint16_t>() { return MPI_UNSIGNED_SHORT; }
 
-   
-    int c;
-    auto skip_ws_comments = [&](FILE* fp) {
-        while ((c = fgetc(fp)) != EOF) {
-            if (isspace(c)) continue;
-            if (c == '#') { 
-                while ((c = fgetc(fp)) != EOF && c != '\n') {}
-                continue;
+
+// Muestras de 16 bits: el archivo es big-endian. La conversion se hace en
+// sitio leyendo los dos bytes de cada muestra antes de escribirla.
+template <typename T>
+void samples_from_file(T* samples, size_t count) {
+    if (sizeof(T) == 1) return;
+    const unsigned char* bytes = (const unsigned char*) samples;
+    for (size_t i = 0; i < count; i++) samples[i] = (T) ((bytes[2*i] << 8) | bytes[2*i + 1]);
+}
+
+template <typename T>
+void samples_to_file(const T* samples, unsigned char* bytes, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (sizeof(T) == 1) {
+            bytes[i] = (unsigned char) samples[i];
+        } else {
+            bytes[2*i] = (unsigned char) (samples[i] >> 8);
+            bytes[2*i + 1] = (unsigned char) (samples[i] & 0xff);
+        }
+    }
+}
+
+
+// Lectura MPI-IO (P5/P6): cada rango lee del archivo sus filas y los halos,
+// sin pasar por rank 0. Las llamadas son colectivas, asi que todos los
+// rangos hacen las dos lecturas (las que no necesitan, con 0 filas). La
+// segunda solo la usan las bandas de los extremos con --border wrap.
+template <typename T>
+bool read_strip_mpiio(const char* input, const PNMHeader& header, int y0, int y1, int radius, bool active,
+                      bool wrap, T* src, size_t& bytes_read) {
+    const int height = header.height;
+    const size_t row_bytes = (size_t) header.width * header.channels * sizeof(T);
+    MPI_File fh;
+    if (MPI_File_open(MPI_COMM_WORLD, input, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        cerr << "Error: MPI-IO no pudo abrir " << input << "\n";
+        return false;
+    }
+    MPI_Datatype row_type;
+    MPI_Type_contiguous((int) row_bytes, MPI_BYTE, &row_type);
+    MPI_Type_commit(&row_type);
+
+    int first[2] = { 0, 0 }, rows[2] = { 0, 0 };
+    if (active) {
+        first[0] = max(0, y0 - radius);
+        rows[0] = min(height, y1 + radius) - first[0];
+        if (wrap && y0 == 0 && y1 < height) first[1] = height - radius, rows[1] = radius;
+        if (wrap && y1 == height && y0 > 0) first[1] = 0, rows[1] = radius;
+    }
+    bool ok = true;
+    bytes_read = 0;
+    for (int k = 0; k < 2; k++) {
+        MPI_Offset offset = (MPI_Offset) header.data_offset + (MPI_Offset) first[k] * (MPI_Offset) row_bytes;
+        T* dst = active ? src + (size_t) first[k] * (row_bytes / sizeof(T)) : nullptr;
+        MPI_Status status;
+        int got = 0;
+        if (MPI_File_read_at_all(fh, offset, dst, rows[k], row_type, &status) != MPI_SUCCESS) ok = false;
+        MPI_Get_count(&status, row_type, &got);
+        if (got != rows[k]) ok = false;
+        if (rows[k] > 0) samples_from_file(dst, (size_t) rows[k] * (row_bytes / sizeof(T)));
+        bytes_read += (size_t) rows[k] * row_bytes;
+    }
+
+    MPI_Type_free(&row_type);
+    MPI_File_close(&fh);
+    if (!ok) cerr << "Error leyendo píxeles con MPI-IO: archivo truncado\n";
+    return ok;
+}
+
+
+// Escritura MPI-IO: rank 0 escribe la cabecera y cada rango su banda en su
+// posicion del mismo archivo, con una escritura colectiva.
+template <typename T>
+bool write_strip_mpiio(const char* output, const PNMHeader& header, int y0, int y1, const T* strip) {
+    char text[64];
+    int text_len = snprintf(text, sizeof(text), "%s\n%d %d\n%d\n", header.magic, header.width, header.height,
+                            header.max_color);
+    const size_t row_bytes = (size_t) header.width * header.channels * sizeof(T);
+    const size_t strip_bytes = (size_t) (y1 - y0) * row_bytes;
+
+    MPI_File fh;
+    if (MPI_File_open(MPI_COMM_WORLD, output, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        cerr << "Error: MPI-IO no pudo abrir " << output << " para escritura\n";
+        return false;
+    }
+    // Trunca un archivo anterior mas largo.
+    bool ok = MPI_File_set_size(fh, (MPI_Offset) text_len + (MPI_Offset) header.height * row_bytes) == MPI_SUCCESS;
+
+    unsigned char* payload = nullptr;
+    if (sizeof(T) == 2 && strip_bytes > 0) {
+        payload = (unsigned char*) malloc(strip_bytes);
+        if (!payload) { cerr << "Error reservando memoria\n"; MPI_Abort(MPI_COMM_WORLD, 1); }
+        samples_to_file(strip, payload, strip_bytes / 2);
+    }
+    const void* data = payload ? (const void*) payload : (const void*) strip;
+
+    MPI_Datatype row_type;
+    MPI_Type_contiguous((int) row_bytes, MPI_BYTE, &row_type);
+    MPI_Type_commit(&row_type);
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    if (rank == 0 && MPI_File_write_at(fh, 0, text, text_len, MPI_CHAR, MPI_STATUS_IGNORE) != MPI_SUCCESS) ok = false;
+    MPI_Offset offset = (MPI_Offset) text_len + (MPI_Offset) y0 * (MPI_Offset) row_bytes;
+    if (MPI_File_write_at_all(fh, offset, data, y1 - y0, row_type, MPI_STATUS_IGNORE) != MPI_SUCCESS) ok = false;
+
+    MPI_Type_free(&row_type);
+    if (MPI_File_close(&fh) != MPI_SUCCESS) ok = false;
+    free(payload);
+    if (!ok) cerr << "Error escribiendo " << output << "\n";
+    return ok;
+}
+
+
+// Con mpi_io (entrada binaria) cada rango lee y escribe su banda con
+// MPI-IO. Si no, rank 0 carga la imagen, reparte las bandas con Scatterv,
+// los vecinos se pasan el halo y Gatherv junta el resultado en rank 0.
+template <typename T>
+bool filter_image(int rank, int world, const PNMHeader& header, const char* input, const char* outprefix,
+                  const char* filter_name, const Kernel& kernel, ConvOptions conv, bool mpi_io, int threads) {
+    const int width = header.width, height = header.height, max_color = header.max_color;
+    const int channels = header.channels;
+    const int radius = kernel.radius();
+    const size_t pitch = (size_t) width * channels;
+    const bool wrap = (conv.border == BORDER_WRAP);
+
+    conv.round_nearest = true;
+    ConvPlan<T> plan(kernel, width, height, channels, max_color, conv);
+    RowStrips strips(height, world, radius, plan.rowAlignment());
+    const int y0 = strips.first[rank], y1 = y0 + strips.rows[rank];
+    const bool active = (rank < strips.active);
+
+    // La banda local guarda las filas [lo, hi) en su posicion absoluta
+    // (src = band - lo * pitch), como espera ConvPlan::run. Con wrap, las
+    // bandas de los extremos leen filas del otro extremo: usan un buffer del
+    // alto de la imagen del que solo tocan su banda y los halos.
+    int lo = max(0, y0 - radius), hi = min(height, y1 + radius);
+    if (wrap && active && (y0 == 0 || y1 == height)) {
+        lo = 0;
+        hi = height;
+    }
+    T* band = nullptr;
+    T* out_pixels = nullptr;
+    if (active) {
+        ProfileScope scope(STAGE_ALLOCATE, (double) ((hi - lo) + (y1 - y0)) * pitch * sizeof(T));
+        band = (T*) malloc((size_t) (hi - lo) * pitch * sizeof(T));
+        out_pixels = (T*) malloc(max((size_t) (y1 - y0) * pitch, (size_t) 1) * sizeof(T));
+        if (!band || !out_pixels) { cerr << "Rank " << rank << ": malloc failed\n"; MPI_Abort(MPI_COMM_WORLD,1); }
+    }
+    T* src = active ? band - (ptrdiff_t) lo * (ptrdiff_t) pitch : nullptr;
+
+    vector<int> counts(world), displs(world);
+    for (int r = 0; r < world; r++) {
+        counts[r] = strips.rows[r] * (int) pitch;
+        displs[r] = strips.first[r] * (int) pitch;
+    }
+
+    double t_start = MPI_Wtime();
+    T* pixels = nullptr;
+    MPI_Request requests[4];
+    int pending = 0;
+    size_t bytes_read = 0;
+
+    if (mpi_io) {
+        ProfileScope scope(STAGE_PARSE);
+        if (!read_strip_mpiio(input, header, y0, y1, radius, active, wrap, src, bytes_read)) {
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        scope.addBytes(bytes_read);
+    } else {
+        if (rank == 0) {
+            char magic[3];
+            int w, h, maxc, pixel_count;
+            PNMReadStats read_stats;
+            if (!load_pnm(input, magic, w, h, maxc, pixels, pixel_count, &read_stats)) {
+                cerr << "Rank 0: error cargando imagen " << input << "\n";
+                MPI_Abort(MPI_COMM_WORLD, 1);
             }
-            ungetc(c, fp);
-            break;
+            pnm_report_read(read_stats);
         }
-    };
 
-    skip_ws_comments(f);
-    if (fscanf(f, "%d %d", &width, &height) != 2) { fclose(f); return false; }
+        // Rank 0 reparte las bandas (sin halo).
+        ProfileScope scope(STAGE_COMM, (double) counts[rank] * sizeof(T));
+        MPI_Scatterv(pixels, counts.data(), displs.data(), mpi_sample_type<T>(),
+                     active ? src + (size_t) y0 * pitch : nullptr, counts[rank], mpi_sample_type<T>(),
+                     0, MPI_COMM_WORLD);
+
+        // Halo sin bloquear: las r primeras filas van al vecino de arriba y
+        // las r ultimas al de abajo. Sin wrap, los extremos no tienen vecino
+        // (MPI_PROC_NULL). Con un solo rango activo la banda ya es la imagen
+        // entera.
+        if (active && strips.active > 1) {
+            int up = (rank > 0) ? rank - 1 : (wrap ? strips.active - 1 : MPI_PROC_NULL);
+            int down = (rank < strips.active - 1) ? rank + 1 : (wrap ? 0 : MPI_PROC_NULL);
+            int top = (y0 - radius + height) % height;
+            int bottom = y1 % height;
+            int halo = radius * (int) pitch;
+            MPI_Irecv(src + (size_t) bottom * pitch, halo, mpi_sample_type<T>(), down, 0, MPI_COMM_WORLD, &requests[0]);
+            MPI_Irecv(src + (size_t) top * pitch, halo, mpi_sample_type<T>(), up, 1, MPI_COMM_WORLD, &requests[1]);
+            MPI_Isend(src + (size_t) y0 * pitch, halo, mpi_sample_type<T>(), up, 0, MPI_COMM_WORLD, &requests[2]);
+            MPI_Isend(src + (size_t) (y1 - radius) * pitch, halo, mpi_sample_type<T>(), down, 1, MPI_COMM_WORLD, &requests[3]);
+            pending = 4;
+            scope.addBytes(4.0 * halo * sizeof(T));
+        }
+    }
+    double t_read = MPI_Wtime();
+
+    // Mientras viaja el halo se filtran las filas que solo leen la banda:
+    // [a, b), a r filas de cada corte (alineadas, la FFT lee bloques
+    // enteros). Los bordes [y0, a) y [b, y1) esperan al halo.
+    clock_t c0 = clock();
+    const int align = plan.rowAlignment();
+    int a = min(y1, (y0 + radius + align - 1) / align * align);
+    int b = max(a, (y1 - radius) / align * align);
+    if (active) {
+        ProfileScope scope(STAGE_FILTER, 2.0 * (b - a) * pitch * sizeof(T));
+        run_rows(plan, src, width, a, b, out_pixels + (size_t) (a - y0) * pitch, pitch, threads);
+    }
+    double t_interior = MPI_Wtime();
+
+    {
+        ProfileScope scope(STAGE_COMM);
+        MPI_Waitall(pending, requests, MPI_STATUSES_IGNORE);
+    }
+    double t_waited = MPI_Wtime();
+
+    if (active) {
+        ProfileScope scope(STAGE_FILTER, 2.0 * ((a - y0) + (y1 - b)) * pitch * sizeof(T));
+        run_rows(plan, src, width, y0, a, out_pixels, pitch, threads);
+        run_rows(plan, src, width, b, y1, out_pixels + (size_t) (b - y0) * pitch, pitch, threads);
+    }
+    clock_t c1 = clock();
+    double t1 = MPI_Wtime();
+
+    double cpu_time = double(c1 - c0) / CLOCKS_PER_SEC;
+    double compute_time = (t_interior - t_read) + (t1 - t_waited);
+    double wait_time = t_waited - t_interior;
+
+    char outname[512];
+    snprintf(outname, sizeof(outname), "%s_%s%s", outprefix, filter_name, (channels == 3) ? ".ppm" : ".pgm");
+    bool saved;
+    if (mpi_io) {
+        ProfileScope scope(STAGE_WRITE, (double) counts[rank] * sizeof(T));
+        saved = write_strip_mpiio(outname, header, y0, y1, out_pixels);
+    } else {
+        // Las bandas filtradas vuelven a rank 0, sobre la imagen de entrada.
+        {
+            ProfileScope scope(STAGE_COMM, (double) counts[rank] * sizeof(T));
+            MPI_Gatherv(out_pixels, counts[rank], mpi_sample_type<T>(),
+                        pixels, counts.data(), displs.data(), mpi_sample_type<T>(), 0, MPI_COMM_WORLD);
+        }
+        saved = (rank != 0) || save_pnm(outname, header.magic, width, height, max_color, pixels,
+                                        height * (int) pitch);
+    }
+    double t_end = MPI_Wtime();
 
-    skip_ws_comments(f);
-    if (fscanf(f, "%d", &max_color) != 1) { fclose(f); return false; }
+    if (rank == 0) {
+        if (saved) cout << "Rank 0: wrote output " << outname << "\n";
+        else cerr << "Rank 0: error saving " << outname << "\n";
+    }
 
-    pixel_count = width * height;
-    if (strcmp(magic, "P3") == 0) pixel_count *= 3;
+    // Lectura MPI-IO: bytes de todos los rangos y el tiempo del mas lento.
+    double read_time = t_read - t_start, slowest_read = 0.0;
+    unsigned long long local_bytes = bytes_read, total_bytes = 0;
+    MPI_Reduce(&read_time, &slowest_read, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&local_bytes, &total_bytes, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (rank == 0 && mpi_io) {
+        cout << "Lectura MPI-IO: " << total_bytes / 1e6 << " MB en " << slowest_read << " s ("
+             << (slowest_read > 0 ? total_bytes / 1e6 / slowest_read : 0.0) << " MB/s)\n";
+    }
 
-    pixels = (int*) malloc(pixel_count * sizeof(int));
-    if (!pixels) { fclose(f); return false; }
+    // Por rango: CPU, calculo, comunicacion (E/S, reparto y recogida) y
+    // espera del halo.
+    double comm_time = (t_read - t_start) + (t_end - t1);
+    double local_times[4] = { cpu_time, compute_time, comm_time, wait_time };
+    double* all_times = nullptr;
+    if (rank == 0) all_times = (double*) malloc(world * 4 * sizeof(double));
+    MPI_Gather(local_times, 4, MPI_DOUBLE, all_times, 4, MPI_DOUBLE, 0, MPI_COMM_WORLD);
 
-    for (int i = 0; i < pixel_count; ++i) {
-        skip_ws_comments(f);
-        if (fscanf(f, "%d", &pixels[i]) != 1) {
-            free(pixels);
-            fclose(f);
-            return false;
+    if (rank == 0) {
+        cout << "=== Tiempos por nodo ===\n";
+        for (int r = 0; r < world; ++r) {
+            const double* t = all_times + r * 4;
+            cout << "Rank " << r << " (filas " << strips.first[r] << "-" << strips.first[r] + strips.rows[r]
+                 << "): CPU time = " << t[0] << " s, calculo = " << t[1] << " s, comunicacion = " << t[2]
+                 << " s, espera = " << t[3] << " s\n";
         }
+        cout << "Tiempo total (lectura + filtro + escritura, " << (mpi_io ? "MPI-IO" : "rank 0") << ") con "
+             << world << " procesos x " << threads << " hilos: " << t_end - t_start << " s\n";
+        free(all_times);
     }
 
-    fclose(f);
-    return true;
+    free(pixels);
+    free(band);
+    free(out_pixels);
+    return saved;
 }
 
 
-bool save_pnm(const char* filename, const char magic[3], int width, int height, int max_color, const int* pixels, int pixel_count) {
-    FILE* f = fopen(filename, "w");
-    if (!f) { cerr << "Error abriendo para escribir " << filename << "\n"; return false; }
-    fprintf(f, "%s\n%d %d\n%d\n", magic, width, height, max_color);
-    for (int i = 0; i < pixel_count; ++i) {
-        fprintf(f, "%d ", pixels[i]);
-        if ((i+1) % 12 == 0) fprintf(f, "\n");
+// ===== Maestro/trabajador =====
+// Rank 0 reparte trabajo bajo demanda: cada trabajador pide una unidad al
+// terminar la anterior, asi los nodos rapidos (o menos cargados) hacen mas.
+// Con una imagen (--dynamic) la unidad es un bloque de filas; con una lista
+// de imagenes, una imagen entera.
+
+enum { TAG_REQUEST = 1, TAG_WORK = 2, TAG_ROWS = 3 };
+
+// Unidades y tiempo ocupado de cada rango, para el informe de equilibrio.
+struct WorkStats {
+    double units;
+    double busy;
+};
+
+static void report_balance(int rank, int world, const WorkStats& local, const char* unit, double total) {
+    vector<WorkStats> all(world);
+    MPI_Gather(&local, 2, MPI_DOUBLE, all.data(), 2, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    if (rank != 0) return;
+
+    // El maestro solo reparte si hay trabajadores.
+    int first = (world > 1) ? 1 : 0;
+    double busiest = 0.0, sum = 0.0;
+    cout << "=== Reparto dinamico ===\n";
+    for (int r = first; r < world; r++) {
+        cout << "Rank " << r << ": " << (long) all[r].units << " " << unit << ", ocupado " << all[r].busy << " s\n";
+        busiest = max(busiest, all[r].busy);
+        sum += all[r].busy;
     }
-    fprintf(f, "\n");
-    fclose(f);
-    return true;
+    double mean = sum / (world - first);
+    cout << "Equilibrio: ocupado maximo / medio = " << (mean > 0 ? busiest / mean : 1.0)
+         << " (1 = perfecto), tiempo total " << total << " s\n";
 }
 
 
-void apply_kernel_block(const int* in_pixels, int* out_pixels,
-                        int width, int height, int channels, int max_color,
-                        const float kernel[3][3]) {
-
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            for (int c = 0; c < channels; ++c) {
-                float sum = 0.0f;
-                float weight_sum = 0.0f;
-                for (int ky = -1; ky <= 1; ++ky) {
-                    for (int kx = -1; kx <= 1; ++kx) {
-                        int nx = x + kx;
-                        int ny = y + ky;
-                        if (nx >= 0 && nx < width && ny >= 0 && ny < height) {
-                            int idx = (ny * width + nx) * channels + c;
-                            sum += in_pixels[idx] * kernel[ky+1][kx+1];
-                            weight_sum += kernel[ky+1][kx+1];
-                        }
-                    }
-                }
-                float value = (weight_sum != 0.0f) ? sum / weight_sum : sum;
-                int result = static_cast<int>(value + 0.5f);
-                if (result < 0) result = 0;
-                if (result > max_color) result = max_color;
-                int idx = (y * width + x) * channels + c;
-                out_pixels[idx] = result;
+// Filas de entrada del bloque [y0, y1): [lo, hi) recortado a la imagen y,
+// con wrap, las filas del otro extremo que lee todo bloque a menos de r
+// filas de un borde (no solo el primero y el ultimo: el ultimo bloque
+// puede tener menos de r filas). wrap_first/wrap_rows[0]: final de la
+// imagen, para y0 - r < 0; [1]: principio, para y1 + r > height. Sin las
+// filas que ya estan en [lo, hi).
+struct TileInput {
+    int lo, hi, wrap_first[2], wrap_rows[2];
+
+    TileInput(int y0, int y1, int radius, int height, bool wrap)
+        : lo(max(0, y0 - radius)), hi(min(height, y1 + radius)), wrap_first{0, 0}, wrap_rows{0, 0} {
+        if (wrap && y0 - radius < 0) {
+            wrap_first[0] = max(hi, height - (radius - y0));
+            wrap_rows[0] = height - wrap_first[0];
+        }
+        if (wrap && y1 + radius > height) {
+            wrap_rows[1] = max(0, min(lo, y1 + radius - height));
+        }
+    }
+
+    int rows() const { return hi - lo + wrap_rows[0] + wrap_rows[1]; }
+};
+
+
+// Una imagen repartida por bloques. El maestro guarda la imagen y el
+// resultado; cada trabajador recibe las filas del bloque con su halo en un
+// buffer del alto de la imagen (solo toca esas filas) y devuelve las filas
+// filtradas.
+template <typename T>
+bool balance_image(int rank, int world, const PNMHeader& header, const char* input, const char* outname,
+                   const Kernel& kernel, ConvOptions conv, int threads) {
+    const int width = header.width, height = header.height, radius = kernel.radius();
+    const size_t pitch = (size_t) width * header.channels;
+    const bool wrap = (conv.border == BORDER_WRAP);
+    conv.round_nearest = true;
+    ConvPlan<T> plan(kernel, width, height, header.channels, header.max_color, conv);
+
+    // Bloques de al menos 16 filas, unos 8 por trabajador, alineados.
+    const int workers = world - 1, align = plan.rowAlignment();
+    int tile_rows = max(16, (height + 8 * workers - 1) / (8 * workers));
+    tile_rows = (tile_rows + align - 1) / align * align;
+    const int tiles = (height + tile_rows - 1) / tile_rows;
+    const MPI_Datatype type = mpi_sample_type<T>();
+
+    double t_start = MPI_Wtime();
+    WorkStats stats = { 0.0, 0.0 };
+    bool saved = true;
+
+    if (rank == 0) {
+        char magic[3];
+        int w, h, maxc, pixel_count;
+        T* pixels = nullptr;
+        PNMReadStats read_stats;
+        if (!load_pnm(input, magic, w, h, maxc, pixels, pixel_count, &read_stats)) {
+            cerr << "Rank 0: error cargando imagen " << input << "\n";
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        pnm_report_read(read_stats);
+        T* result;
+        {
+            ProfileScope scope(STAGE_ALLOCATE, (double) pixel_count * sizeof(T));
+            result = (T*) malloc((size_t) pixel_count * sizeof(T));
+        }
+        if (!result) { cerr << "Rank 0: output malloc failed\n"; MPI_Abort(MPI_COMM_WORLD, 1); }
+
+        // Cada peticion trae el bloque terminado (-1 la primera vez). Para
+        // el perfil, todo el reparto es comunicacion.
+        ProfileScope comm(STAGE_COMM);
+        int next = 0, running = workers;
+        while (running > 0) {
+            int done;
+            MPI_Status status;
+            MPI_Recv(&done, 1, MPI_INT, MPI_ANY_SOURCE, TAG_REQUEST, MPI_COMM_WORLD, &status);
+            int worker = status.MPI_SOURCE;
+            if (done >= 0) {
+                int y0 = done * tile_rows, y1 = min(height, y0 + tile_rows);
+                MPI_Recv(result + (size_t) y0 * pitch, (y1 - y0) * (int) pitch, type, worker, TAG_ROWS,
+                         MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+                comm.addBytes((double) (y1 - y0) * pitch * sizeof(T));
             }
+            int tile = (next < tiles) ? next++ : -1;
+            MPI_Send(&tile, 1, MPI_INT, worker, TAG_WORK, MPI_COMM_WORLD);
+            if (tile < 0) {
+                running--;
+                continue;
+            }
+            int y0 = tile * tile_rows, y1 = min(height, y0 + tile_rows);
+            TileInput in(y0, y1, radius, height, wrap);
+            MPI_Send(pixels + (size_t) in.lo * pitch, (in.hi - in.lo) * (int) pitch, type, worker, TAG_ROWS,
+                     MPI_COMM_WORLD);
+            for (int k = 0; k < 2; k++) {
+                if (in.wrap_rows[k] == 0) continue;
+                MPI_Send(pixels + (size_t) in.wrap_first[k] * pitch, in.wrap_rows[k] * (int) pitch, type, worker,
+                         TAG_ROWS, MPI_COMM_WORLD);
+            }
+            comm.addBytes((double) in.rows() * pitch * sizeof(T));
+        }
+        comm.stop();
+
+        saved = save_pnm(outname, magic, width, height, maxc, result, pixel_count);
+        if (saved) {
+            cout << "Rank 0: wrote output " << outname << "\n";
+        } else {
+            cerr << "Rank 0: error saving " << outname << "\n";
         }
+        free(pixels);
+        free(result);
+    } else {
+        T* src;
+        T* out;
+        {
+            ProfileScope scope(STAGE_ALLOCATE, (double) (height + tile_rows) * pitch * sizeof(T));
+            src = (T*) malloc((size_t) height * pitch * sizeof(T));
+            out = (T*) malloc((size_t) tile_rows * pitch * sizeof(T));
+        }
+        if (!src || !out) { cerr << "Rank " << rank << ": malloc failed\n"; MPI_Abort(MPI_COMM_WORLD, 1); }
+
+        int done = -1;
+        for (;;) {
+            ProfileScope comm(STAGE_COMM);
+            MPI_Send(&done, 1, MPI_INT, 0, TAG_REQUEST, MPI_COMM_WORLD);
+            if (done >= 0) {
+                int y0 = done * tile_rows, y1 = min(height, y0 + tile_rows);
+                MPI_Send(out, (y1 - y0) * (int) pitch, type, 0, TAG_ROWS, MPI_COMM_WORLD);
+                comm.addBytes((double) (y1 - y0) * pitch * sizeof(T));
+            }
+            int tile;
+            MPI_Recv(&tile, 1, MPI_INT, 0, TAG_WORK, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            if (tile < 0) break;
+
+            int y0 = tile * tile_rows, y1 = min(height, y0 + tile_rows);
+            TileInput in(y0, y1, radius, height, wrap);
+            MPI_Recv(src + (size_t) in.lo * pitch, (in.hi - in.lo) * (int) pitch, type, 0, TAG_ROWS,
+                     MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            for (int k = 0; k < 2; k++) {
+                if (in.wrap_rows[k] == 0) continue;
+                MPI_Recv(src + (size_t) in.wrap_first[k] * pitch, in.wrap_rows[k] * (int) pitch, type, 0, TAG_ROWS,
+                         MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            }
+            comm.addBytes((double) in.rows() * pitch * sizeof(T));
+            comm.stop();
+
+            double t0 = MPI_Wtime();
+            {
+                ProfileScope scope(STAGE_FILTER, 2.0 * (y1 - y0) * pitch * sizeof(T));
+                run_rows(plan, src, width, y0, y1, out, pitch, threads);
+            }
+            stats.busy += MPI_Wtime() - t0;
+            stats.units++;
+            done = tile;
+        }
+        free(src);
+        free(out);
     }
+
+    report_balance(rank, world, stats, "bloques", MPI_Wtime() - t_start);
+    return saved;
+}
+
+
+// Filtra una imagen entera en este rango (lote con reparto dinamico).
+template <typename T>
+bool filter_whole_image(const char* input, const char* outname, const Kernel& kernel, ConvOptions conv, int threads) {
+    PNMImage<T> img;
+    if (!img.load(input)) return false;
+    conv.round_nearest = true;
+    ConvPlan<T> plan(kernel, img.getWidth(), img.getHeight(), img.getChannels(), img.getMaxColor(), conv);
+    return filter_image(img, plan, BACKEND_OPENMP, threads) && img.save(outname);
+}
+
+
+// Lote: el maestro reparte indices de imagen; cada trabajador lee, filtra y
+// guarda la imagen (las rutas deben verse desde todos los nodos). Salida:
+// <prefijo>_<nombre>_<filtro>.<ext>. Con un solo proceso, rank 0 lo hace
+// todo. Devuelve false si alguna imagen de este rango fallo.
+static bool balance_batch(int rank, int world, const vector<string>& images, const char* outprefix,
+                          const char* filter_name, const Kernel& kernel, const ConvOptions& conv, int threads) {
+    double t_start = MPI_Wtime();
+    WorkStats stats = { 0.0, 0.0 };
+    bool all_ok = true;
+
+    auto process = [&](int index) {
+        const string& input = images[index];
+        size_t slash = input.find_last_of('/');
+        string base = input.substr(slash == string::npos ? 0 : slash + 1);
+        base = base.substr(0, base.find_last_of('.'));
+
+        double t0 = MPI_Wtime();
+        PNMHeader header;
+        bool ok = pnm_peek_header(input.c_str(), header);
+        string outname = string(outprefix) + "_" + base + "_" + filter_name + (header.channels == 3 ? ".ppm" : ".pgm");
+        if (ok && header.max_color > 255) ok = filter_whole_image<uint16_t>(input.c_str(), outname.c_str(), kernel, conv, threads);
+        else if (ok) ok = filter_whole_image<uint8_t>(input.c_str(), outname.c_str(), kernel, conv, threads);
+        stats.busy += MPI_Wtime() - t0;
+        stats.units++;
+        if (ok) cout << "Rank " << rank << ": " << input << " -> " << outname << "\n";
+        else cerr << "Rank " << rank << ": error filtrando " << input << "\n";
+        all_ok = all_ok && ok;
+    };
+
+    if (world == 1) {
+        for (size_t i = 0; i < images.size(); i++) process((int) i);
+    } else if (rank == 0) {
+        // Las imagenes grandes salen primero, para que la ultima que se
+        // reparte sea pequena y nadie se quede solo al final.
+        vector<pair<long long, int>> order;
+        for (size_t i = 0; i < images.size(); i++) {
+            PNMHeader header;
+            long long size = pnm_peek_header(images[i].c_str(), header)
+                                 ? (long long) header.width * header.height * header.channels : 0;
+            order.push_back(make_pair(-size, (int) i));
+        }
+        sort(order.begin(), order.end());
+
+        ProfileScope comm(STAGE_COMM);
+        int next = 0, running = world - 1;
+        while (running > 0) {
+            int done;
+            MPI_Status status;
+            MPI_Recv(&done, 1, MPI_INT, MPI_ANY_SOURCE, TAG_REQUEST, MPI_COMM_WORLD, &status);
+            int index = (next < (int) order.size()) ? order[next++].second : -1;
+            MPI_Send(&index, 1, MPI_INT, status.MPI_SOURCE, TAG_WORK, MPI_COMM_WORLD);
+            if (index < 0) running--;
+        }
+    } else {
+        int index = -1;
+        for (;;) {
+            {
+                ProfileScope comm(STAGE_COMM);
+                MPI_Send(&index, 1, MPI_INT, 0, TAG_REQUEST, MPI_COMM_WORLD);
+                MPI_Recv(&index, 1, MPI_INT, 0, TAG_WORK, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            }
+            if (index < 0) break;
+            process(index);
+        }
+    }
+
+    report_balance(rank, world, stats, "imagenes", MPI_Wtime() - t_start);
+    return all_ok;
+}
+
+
+// --profile: el perfil de cada rango va a rank 0 como los tiempos por nodo
+// (MPI_Gather) y alli se imprime y, con --profile-json, se guarda.
+static void report_profile(int rank, int world, const char* program, const FilterOptions& opt) {
+    if (!opt.profile) return;
+    ProfileSnapshot local = profiler().snapshot();
+    vector<ProfileSnapshot> all(rank == 0 ? world : 0);
+    MPI_Gather(&local, PROFILE_DOUBLES, MPI_DOUBLE, all.data(), PROFILE_DOUBLES, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    if (rank != 0) return;
+    profile_report(cout, all);
+    if (opt.profile_json) profile_write_json(opt.profile_json, program, all);
+}
+
+
+// Hilos por rango: --threads N, o sin --threads los nucleos del nodo
+// repartidos entre los rangos que comparten el nodo (MPI_COMM_TYPE_SHARED).
+// Si MPI no da MPI_THREAD_FUNNELED se queda en un hilo.
+// Fin comun: perfil, y el codigo de salida es 1 en todos los rangos si
+// alguno fallo (una imagen del lote, el guardado...).
+static int finish(int rank, int world, const char* program, const FilterOptions& opt, bool ok) {
+    report_profile(rank, world, program, opt);
+    int failed = ok ? 0 : 1, any_failed = 0;
+    MPI_Allreduce(&failed, &any_failed, 1, MPI_INT, MPI_LOR, MPI_COMM_WORLD);
+    MPI_Finalize();
+    return any_failed ? 1 : 0;
+}
+
+
+static int rank_threads(int requested, int provided, int rank) {
+    MPI_Comm node;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node);
+    int node_ranks;
+    MPI_Comm_size(node, &node_ranks);
+    MPI_Comm_free(&node);
+
+    int threads = (requested > 0) ? requested : max(1, omp_get_num_procs() / node_ranks);
+    if (threads > 1 && provided < MPI_THREAD_FUNNELED) {
+        if (rank == 0) cerr << "Aviso: MPI no soporta MPI_THREAD_FUNNELED, se usa un hilo por proceso\n";
+        threads = 1;
+    }
+    return threads;
 }
 
 
 int main(int argc, char* argv[]) {
-    MPI_Init(&argc, &argv);
+    // Modo hibrido: cada rango filtra su banda con un equipo de hilos
+    // OpenMP, pero solo el hilo principal llama a MPI.
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
 
     int rank, world;
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
@@ -109,7 +648,7 @@ int main(int argc, char* argv[]) {
 
     if (argc < 4) {
         if (rank == 0) {
-            cout << "Uso: " << argv[0] << " <input_image> <output_prefix> --f <filter>\n";
+            cout << "Uso: " << argv[0] << " <input_image>[,imagen2,...] <output_prefix> --f <filter>|--kernel <fichero> [--radius N] [--border modo] [--precision fixed|float] [--algo auto|direct|separable|fft] [--threads N] [--root-io] [--dynamic] [--profile] [--profile-json fichero]\n";
             cout << "Ejemplo (ejecutar con mpirun): mpirun -np 4 ./mpi_filterer sulfur.pgm sulfur --f blur\n";
         }
         MPI_Finalize();
@@ -121,8 +660,8 @@ int main(int argc, char* argv[]) {
 
     
     if (rank == 0) {
-        if (argc < 5 || strcmp(argv[3], "--f") != 0) {
-            cerr << "Error: se esperaba --f <filter>\n";
+        if (argc < 5 || (strcmp(argv[3], "--f") != 0 && strcmp(argv[3], "--kernel") != 0)) {
+            cerr << "Error: se esperaba --f <filter> o --kernel <fichero>\n";
             MPI_Abort(MPI_COMM_WORLD, 1);
         }
     }
@@ -132,100 +671,60 @@ int main(int argc, char* argv[]) {
     MPI_Bcast(filter_name, 32, MPI_CHAR, 0, MPI_COMM_WORLD);
 
    
-    float blur_kernel[3][3] = {{1.0f/9,1.0f/9,1.0f/9},{1.0f/9,1.0f/9,1.0f/9},{1.0f/9,1.0f/9,1.0f/9}};
-    float laplace_kernel[3][3] = {{0,-1,0},{-1,4,-1},{0,-1,0}};
-    float sharpen_kernel[3][3] = {{0,-1,0},{-1,5,-1},{0,-1,0}};
-    const float (*kernel)[3] = nullptr;
-
-    if (strcmp(filter_name, "blur") == 0) kernel = blur_kernel;
-    else if (strcmp(filter_name, "laplace") == 0) kernel = laplace_kernel;
-    else if (strcmp(filter_name, "sharpen") == 0) kernel = sharpen_kernel;
-    else {
-        if (rank == 0) cerr << "Filtro no reconocido: " << filter_name << "\n";
+    FilterOptions opt;
+    if (!parse_filter_options(argc, argv, 3, opt)) MPI_Abort(MPI_COMM_WORLD, 1);
+    if (opt.profile) profiler().enable();
+
+    // El fichero de --kernel solo lo lee rank 0; el resto recibe los taps.
+    Kernel kernel;
+    if (opt.kernel_file) {
+        if (rank == 0 && !load_kernel_file(opt.kernel_file, kernel)) MPI_Abort(MPI_COMM_WORLD, 1);
+        MPI_Bcast(&kernel.size, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        kernel.taps.resize((size_t) kernel.size * kernel.size);
+        MPI_Bcast(kernel.taps.data(), kernel.size * kernel.size, MPI_FLOAT, 0, MPI_COMM_WORLD);
+    } else if (!filter_kernel(filter_name, opt.radius, kernel)) {
+        if (rank == 0) filter_kernel_error(filter_name, opt.radius);
         MPI_Abort(MPI_COMM_WORLD,1);
     }
 
-    
-    char magic[3] = {'\0','\0','\0'};
-    int width = 0, height = 0, max_color = 0;
-    int channels = 1;
-    int pixel_count = 0;
-    int* pixels = nullptr;
-
-    if (rank == 0) {
-        if (!load_pnm(input, magic, width, height, max_color, pixels, pixel_count)) {
-            cerr << "Rank 0: error cargando imagen " << input << "\n";
-            MPI_Abort(MPI_COMM_WORLD, 1);
-        }
+    // La salida es <prefijo>_<filtro>.<ext>, como en filtro_omp.
+    const char* label = opt.kernel_file ? "kernel" : filter_name;
+    int threads = rank_threads(opt.threads, provided, rank);
+
+    // Varias imagenes separadas por comas: lote con reparto dinamico.
+    vector<string> images;
+    for (const char* p = input; *p; ) {
+        const char* comma = strchr(p, ',');
+        size_t len = comma ? (size_t) (comma - p) : strlen(p);
+        if (len > 0) images.push_back(string(p, len));
+        p += len + (comma ? 1 : 0);
     }
-
-    
-    MPI_Bcast(magic, 3, MPI_CHAR, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&width, 1, MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&height, 1, MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&max_color, 1, MPI_INT, 0, MPI_COMM_WORLD);
-
-    if (rank != 0) {
-        channels = (strcmp(magic, "P3") == 0) ? 3 : 1;
-        pixel_count = width * height * channels;
-        pixels = (int*) malloc(pixel_count * sizeof(int));
-        if (!pixels) { cerr << "Rank " << rank << ": malloc failed\n"; MPI_Abort(MPI_COMM_WORLD,1); }
-    } else {
-        channels = (strcmp(magic, "P3") == 0) ? 3 : 1;
+    if (images.size() > 1) {
+        bool ok = balance_batch(rank, world, images, outprefix, label, kernel, opt.convOptions(), threads);
+        return finish(rank, world, argv[0], opt, ok);
     }
 
-    
-    MPI_Bcast(pixels, pixel_count, MPI_INT, 0, MPI_COMM_WORLD);
-
-
-    int* out_pixels = (int*) malloc(pixel_count * sizeof(int));
-    if (!out_pixels) { cerr << "Rank " << rank << ": output malloc failed\n"; MPI_Abort(MPI_COMM_WORLD,1); }
-
-    
-    double t0 = MPI_Wtime();
-    clock_t c0 = clock();
-
- 
-    apply_kernel_block(pixels, out_pixels, width, height, channels, max_color, kernel);
-
-    clock_t c1 = clock();
-    double t1 = MPI_Wtime();
-
-    double cpu_time = double(c1 - c0) / CLOCKS_PER_SEC;
-    double wall_time = t1 - t0;
-
-   
-    char outname[512];
-    snprintf(outname, sizeof(outname), "%s_rank%d.ppm", outprefix, rank);
-    if (!save_pnm(outname, magic, width, height, max_color, out_pixels, pixel_count)) {
-        cerr << "Rank " << rank << ": error saving " << outname << "\n";
-        
-    } else {
-        if (rank == 0) {
-            cout << "Rank " << rank << ": wrote output " << outname << "\n";
-        }
+    // Solo rank 0 interpreta la cabecera; el tipo de muestra depende de
+    // maxval (uint8_t si <= 255, uint16_t si no).
+    PNMHeader header;
+    if (rank == 0 && !pnm_peek_header(input, header)) {
+        cerr << "Rank 0: error cargando imagen " << input << "\n";
+        MPI_Abort(MPI_COMM_WORLD, 1);
     }
-
-    
-    double local_times[2] = { cpu_time, wall_time };
-    double* all_times = nullptr;
-    if (rank == 0) all_times = (double*) malloc(world * 2 * sizeof(double));
-    MPI_Gather(local_times, 2, MPI_DOUBLE, all_times, 2, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-
-    if (rank == 0) {
-      
-        cout << "=== Tiempos por nodo ===\n";
-        for (int r = 0; r < world; ++r) {
-            double ctime_r = all_times[r*2 + 0];
-            double wtime_r = all_times[r*2 + 1];
-            cout << "Rank " << r << ": CPU time = " << ctime_r << " s, wall time = " << wtime_r << " s\n";
-        }
-        free(all_times);
+    MPI_Bcast(&header, sizeof(header), MPI_BYTE, 0, MPI_COMM_WORLD);
+    bool mpi_io = header.binary && !opt.root_io;
+
+    // --dynamic con un solo proceso no tiene trabajadores: reparto estatico.
+    bool ok;
+    if (opt.dynamic && world > 1) {
+        char outname[512];
+        snprintf(outname, sizeof(outname), "%s_%s%s", outprefix, label, (header.channels == 3) ? ".ppm" : ".pgm");
+        if (header.max_color > 255) ok = balance_image<uint16_t>(rank, world, header, input, outname, kernel, opt.convOptions(), threads);
+        else ok = balance_image<uint8_t>(rank, world, header, input, outname, kernel, opt.convOptions(), threads);
+    } else if (header.max_color > 255) {
+        ok = filter_image<uint16_t>(rank, world, header, input, outprefix, label, kernel, opt.convOptions(), mpi_io, threads);
+    } else {
+        ok = filter_image<uint8_t>(rank, world, header, input, outprefix, label, kernel, opt.convOptions(), mpi_io, threads);
     }
-
-    free(pixels);
-    free(out_pixels);
-
-    MPI_Finalize();
-    return 0;
+    return finish(rank, world, argv[0], opt, ok);
 }
@@ -2,223 +2,438 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <cstdint>
 #include <algorithm>
-#include <ctime>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cctype>
+#include <dirent.h>
 #include <omp.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include "pnmfilter.h"
+#include "options.h"
+#include "batch.h"
 using namespace std;
 
-class PNMImage {
-private:
-    char magic[3];
-    int width;
-    int height;
-    int max_color;
-    int* pixels;
-    int pixel_count;
+// La imagen se lee una sola vez y todos los filtros trabajan sobre ella por
+// bloques 2D del tamano de la L2 (omp for con --schedule):
+//  - filtros independientes (--f blur,laplace,sharpen): cada bloque de la
+//    fuente pasa por todos los filtros mientras esta en cache;
+//  - cadena (--chain blur>sharpen): cada bloque atraviesa todas las etapas
+//    y los intermedios viven en ventanas de pocas filas por hilo.
+
+// Parte "a,b,c" (o "a>b>c") en nombres.
+static vector<string> split_filters(const char* text, char separator) {
+    vector<string> names;
+    string current;
+    for (const char* p = text; ; p++) {
+        if (*p == separator || *p == '\0') {
+            if (!current.empty()) names.push_back(current);
+            current.clear();
+            if (*p == '\0') break;
+        } else {
+            current += *p;
+        }
+    }
+    return names;
+}
+
+// Tamano de la L2 (por nucleo); 1 MB si el sistema no lo informa.
+static size_t l2_cache_bytes() {
+    long size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    return (size > 0) ? (size_t) size : 1024 * 1024;
+}
 
-public:
-    PNMImage() : width(0), height(0), max_color(0), pixels(nullptr), pixel_count(0) {
-        magic[0] = '\0';
+// Nodos NUMA en linea segun /sys (1 si no se puede saber).
+static int numa_nodes() {
+    DIR* dir = opendir("/sys/devices/system/node");
+    if (!dir) return 1;
+    int nodes = 0;
+    while (dirent* entry = readdir(dir)) {
+        if (strncmp(entry->d_name, "node", 4) == 0 && isdigit((unsigned char) entry->d_name[4])) nodes++;
     }
+    closedir(dir);
+    return max(nodes, 1);
+}
 
-    ~PNMImage() {
-        if (pixels) free(pixels);
+// --pin: el hilo i de OpenMP queda fijo en la i-esima CPU permitida, asi
+// sus bloques (y las paginas que toco primero) no cambian de nodo.
+static void pin_threads() {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return;
+    vector<int> cpus;
+    for (int c = 0; c < CPU_SETSIZE; c++) {
+        if (CPU_ISSET(c, &allowed)) cpus.push_back(c);
     }
+    if (cpus.empty()) return;
 
-    const char* getMagic() const { 
-        return magic;
+    #pragma omp parallel
+    {
+        cpu_set_t one;
+        CPU_ZERO(&one);
+        CPU_SET(cpus[omp_get_thread_num() % cpus.size()], &one);
+        pthread_setaffinity_np(pthread_self(), sizeof(one), &one);
     }
+}
 
-    bool load(const char* filename) {
-        FILE* file = fopen(filename, "r");
-        if (!file) {
-            cerr << "Error: no se pudo abrir " << filename << endl;
-            return false;
-        }
+static bool set_schedule(const char* name) {
+    if (strcmp(name, "static") == 0) omp_set_schedule(omp_sched_static, 0);
+    else if (strcmp(name, "dynamic") == 0) omp_set_schedule(omp_sched_dynamic, 1);
+    else if (strcmp(name, "guided") == 0) omp_set_schedule(omp_sched_guided, 1);
+    else return false;
+    return true;
+}
 
-        if (fscanf(file, "%2s", magic) != 1) {
-            cerr << "Error leyendo magic number" << endl;
-            fclose(file);
-            return false;
-        }
 
-        if (fscanf(file, "%d %d", &width, &height) != 2) {
-            cerr << "Error leyendo width/height" << endl;
-            fclose(file);
-            return false;
-        }
+// Rejilla de bloques 2D. Las buffers ventanas de un bloque (con el halo)
+// ocupan ~media L2; si ni 16 filas completas caben, el bloque se parte
+// tambien en columnas (multiplos de 64 pixeles). Hay al menos 4 bloques por
+// hilo y el alto es multiplo de align (bloques FFT). Los bloques se
+// numeran por filas, asi que con schedule(static) cada hilo se queda con
+// una franja horizontal.
+struct TileGrid {
+    int tile_w, tile_h, cols, rows;
 
-        if (fscanf(file, "%d", &max_color) != 1) {
-            cerr << "Error leyendo max_color" << endl;
-            fclose(file);
-            return false;
-        }
+    int count() const { return cols * rows; }
 
-        pixel_count = width * height;
-        if (strcmp(magic, "P3") == 0) pixel_count *= 3;
+    void bounds(int tile, int width, int height, int& x0, int& x1, int& y0, int& y1) const {
+        x0 = (tile % cols) * tile_w;
+        y0 = (tile / cols) * tile_h;
+        x1 = min(width, x0 + tile_w);
+        y1 = min(height, y0 + tile_h);
+    }
+};
 
-        pixels = (int*) malloc(pixel_count * sizeof(int));
-        if (!pixels) {
-            cerr << "Error reservando memoria" << endl;
-            fclose(file);
-            return false;
-        }
+static TileGrid tile_grid(int width, int height, size_t pixel_bytes, int halo, int buffers, int align) {
+    const size_t budget = l2_cache_bytes() / 2;
+    const int threads = omp_get_max_threads();
+    const int min_rows = max(4 * halo, 16);
+
+    TileGrid grid;
+    grid.tile_w = width;
+    size_t row_bytes = (size_t) width * pixel_bytes * buffers;
+    int rows = (int) (budget / row_bytes) - 2 * halo;
+    if (rows < min_rows) {
+        rows = min_rows;
+        size_t cols_fit = budget / ((size_t) (rows + 2 * halo) * pixel_bytes * buffers);
+        grid.tile_w = min(width, max(64, (int) (cols_fit / 64 * 64)));
+    }
+    grid.cols = (width + grid.tile_w - 1) / grid.tile_w;
 
-        for (int i = 0; i < pixel_count; i++) {
-            if (fscanf(file, "%d", &pixels[i]) != 1) {
-                cerr << "Error leyendo píxeles" << endl;
-                free(pixels);
-                pixels = nullptr;
-                fclose(file);
-                return false;
-            }
-        }
+    int balance = (height * grid.cols + 4 * threads - 1) / (4 * threads);
+    rows = max(min(rows, max(balance, 1)), min(min_rows, height));
+    grid.tile_h = (rows + align - 1) / align * align;
+    grid.rows = (height + grid.tile_h - 1) / grid.tile_h;
+    return grid;
+}
 
-        fclose(file);
-        return true;
-    }
+template <typename T>
+T* alloc_result(const PNMImage<T>& img) {
+    ProfileScope scope(STAGE_ALLOCATE, (double) img.getPixelCount() * sizeof(T));
+    T* result = (T*) malloc((size_t) img.getPixelCount() * sizeof(T));
+    if (!result) cerr << "Error reservando memoria para el filtro" << endl;
+    return result;
+}
 
-    bool save(const char* filename) const {
-        FILE* out = fopen(filename, "w");
-        if (!out) {
-            cerr << "Error: no se pudo abrir " << filename << " para escritura" << endl;
-            return false;
+// Primer toque NUMA: cada hilo escribe (o copia desde src) sus bloques con
+// el mismo reparto static que usara el filtrado, asi las paginas quedan en
+// su nodo.
+template <typename T>
+void first_touch(const TileGrid& grid, int width, int height, int channels, T* dst, const T* src) {
+    const size_t pitch = (size_t) width * channels;
+    #pragma omp parallel for schedule(static)
+    for (int tile = 0; tile < grid.count(); tile++) {
+        profile_thread();
+        int x0, x1, y0, y1;
+        grid.bounds(tile, width, height, x0, x1, y0, y1);
+        for (int y = y0; y < y1; y++) {
+            size_t offset = y * pitch + (size_t) x0 * channels;
+            size_t bytes = (size_t) (x1 - x0) * channels * sizeof(T);
+            if (src) memcpy(dst + offset, src + offset, bytes);
+            else memset(dst + offset, 0, bytes);
         }
+    }
+}
 
-        fprintf(out, "%s\n%d %d\n%d\n", magic, width, height, max_color);
 
-        for (int i = 0; i < pixel_count; i++) {
-            fprintf(out, "%d ", pixels[i]);
-            if ((i + 1) % 12 == 0) fprintf(out, "\n");
+// Filtros independientes en una pasada: results[f] = plans[f] sobre la
+// fuente, bloque a bloque (schedule(runtime), ver --schedule).
+template <typename T>
+void runFused(const T* pixels, int width, int height, const TileGrid& grid,
+              const vector<unique_ptr<ConvPlan<T>>>& plans, const vector<T*>& results, size_t pitch) {
+    #pragma omp parallel for schedule(runtime)
+    for (int tile = 0; tile < grid.count(); tile++) {
+        profile_thread();
+        int x0, x1, y0, y1;
+        grid.bounds(tile, width, height, x0, x1, y0, y1);
+        for (size_t f = 0; f < plans.size(); f++) {
+            plans[f]->run(pixels, x0, x1, y0, y1, results[f] + y0 * pitch, pitch);
         }
-
-        fclose(out);
-        return true;
     }
+}
 
-    void applyKernel(const float kernel[3][3]) {
-        int* result_pixels = (int*) malloc(pixel_count * sizeof(int));
-        if (!result_pixels) {
-            cerr << "Error reservando memoria para el filtro" << endl;
-            return;
+// Cadena de filtros fusionada por bloques. Para producir las filas
+// [y0, y1) de la ultima etapa, cada etapa anterior calcula solo las filas
+// que lee la siguiente (r filas mas por lado, alineadas a su rowAlignment)
+// en una ventana del hilo. Las ventanas son de filas completas (grid.cols
+// es 1). Como run() da el mismo pixel para cualquier region, el resultado
+// es el de aplicar los filtros uno tras otro.
+//
+// Con --border wrap la primera fila lee la ultima de la etapa anterior, asi
+// que cada etapa se filtra entera (en paralelo) antes de la siguiente.
+template <typename T>
+void runChain(const T* pixels, int width, int height, const TileGrid& grid,
+              const vector<unique_ptr<ConvPlan<T>>>& plans, const vector<int>& radius,
+              bool wrap, T* result, T* spare, size_t pitch) {
+    const int stages = (int) plans.size();
+
+    if (wrap) {
+        const T* src = pixels;
+        // Alterna entre result y spare para que la ultima etapa caiga en result.
+        for (int s = 0; s < stages; s++) {
+            T* dst = ((stages - 1 - s) % 2 == 0) ? result : spare;
+            #pragma omp parallel for schedule(runtime)
+            for (int tile = 0; tile < grid.count(); tile++) {
+                profile_thread();
+                int x0, x1, y0, y1;
+                grid.bounds(tile, width, height, x0, x1, y0, y1);
+                plans[s]->run(src, x0, x1, y0, y1, dst + y0 * pitch, pitch);
+            }
+            src = dst;
         }
+        return;
+    }
 
-        int channels = (strcmp(magic, "P3") == 0) ? 3 : 1;
-
-        #pragma omp parallel for collapse(2)
-        for (int y = 0; y < height; y++) {
-            for (int x = 0; x < width; x++) {
-                for (int c = 0; c < channels; c++) {
-                    float sum = 0.0, weight_sum = 0.0;
-
-                    for (int ky = -1; ky <= 1; ky++) {
-                        for (int kx = -1; kx <= 1; kx++) {
-                            int nx = x + kx, ny = y + ky;
-                            if (nx >= 0 && nx < width && ny >= 0 && ny < height) {
-                                int idx = (ny * width + nx) * channels + c;
-                                sum += pixels[idx] * kernel[ky + 1][kx + 1];
-                                weight_sum += kernel[ky + 1][kx + 1];
-                            }
-                        }
-                    }
-
-                    float value = (weight_sum != 0) ? sum / weight_sum : sum;
-                    int result = static_cast<int>(value);
-                    result = max(0, min(max_color, result));
-
-                    int idx = (y * width + x) * channels + c;
-                    result_pixels[idx] = result;
+    #pragma omp parallel
+    {
+        vector<vector<T>> window(stages);
+        vector<int> lo(stages), hi(stages);
+
+        #pragma omp for schedule(runtime)
+        for (int tile = 0; tile < grid.rows; tile++) {
+            profile_thread();
+            lo[stages - 1] = tile * grid.tile_h;
+            hi[stages - 1] = min(height, lo[stages - 1] + grid.tile_h);
+            for (int s = stages - 2; s >= 0; s--) {
+                int a = plans[s]->rowAlignment();
+                lo[s] = max(0, lo[s + 1] - radius[s + 1]) / a * a;
+                hi[s] = min(height, (min(height, hi[s + 1] + radius[s + 1]) + a - 1) / a * a);
+            }
+
+            // La etapa 0 lee la imagen; las demas, la ventana anterior, que
+            // empieza en la fila lo[s - 1] (run() indexa por fila absoluta).
+            const T* src = pixels;
+            for (int s = 0; s < stages; s++) {
+                T* dst;
+                if (s == stages - 1) {
+                    dst = result + lo[s] * pitch;
+                } else {
+                    window[s].resize((size_t) (hi[s] - lo[s]) * pitch);
+                    dst = window[s].data();
                 }
+                plans[s]->run(src, 0, width, lo[s], hi[s], dst, pitch);
+                src = dst - (ptrdiff_t) lo[s] * (ptrdiff_t) pitch;
             }
         }
+    }
+}
+
 
-        free(pixels);
-        pixels = result_pixels;
+// 0 si todas las salidas se guardaron (o, con --async-write, se
+// encolaron), 1 si no.
+template <typename T>
+int run(const char* input_file, const char* output_prefix, const FilterOptions& opt, PNMAsyncWriter* writer) {
+    PNMImage<T> img;
+    if (!img.load(input_file)) return 1;
+    pnm_report_read(img.getReadStats());
+
+    // Con --kernel solo hay un filtro: <prefix>_kernel.<ext> (main rechaza
+    // --chain con --kernel).
+    bool chain = (opt.chain != nullptr);
+    vector<string> names;
+    if (opt.kernel_file) names.push_back(opt.filterName());
+    else if (chain) names = split_filters(opt.chain, '>');
+    else names = split_filters(opt.filter ? opt.filter : "blur,laplace,sharpen", ',');
+    if (names.empty()) {
+        cerr << "Error: lista de filtros vacia" << endl;
+        return 1;
     }
 
-    void applyBlur() {
-        const float kernel[3][3] = {
-            {1.0 / 9, 1.0 / 9, 1.0 / 9},
-            {1.0 / 9, 1.0 / 9, 1.0 / 9},
-            {1.0 / 9, 1.0 / 9, 1.0 / 9}
-        };
-        applyKernel(kernel);
+    const int width = img.getWidth(), height = img.getHeight(), channels = img.getChannels();
+    const size_t pitch = (size_t) width * channels;
+    vector<unique_ptr<ConvPlan<T>>> plans;
+    vector<int> radius;
+    int align = 1, halo = 0;
+    for (const string& name : names) {
+        Kernel kernel;
+        if (!load_filter_kernel(name.c_str(), opt, kernel)) return 1;
+        plans.emplace_back(new ConvPlan<T>(kernel, width, height, channels, img.getMaxColor(), opt.convOptions()));
+        radius.push_back(kernel.radius());
+        align = max(align, plans.back()->rowAlignment());
+        halo = max(halo, kernel.radius());
     }
 
-    void applyLaplace() {
-        const float kernel[3][3] = {
-            {0, -1, 0},
-            {-1, 4, -1},
-            {0, -1, 0}
-        };
-        applyKernel(kernel);
+    // La cadena fusionada trabaja con filas completas: una ventana por
+    // etapa y el halo acumulado de las etapas siguientes.
+    bool wrap = (opt.border == BORDER_WRAP);
+    TileGrid grid;
+    if (chain && !wrap) {
+        int chain_halo = 0;
+        for (size_t s = 1; s < radius.size(); s++) chain_halo += radius[s];
+        grid = tile_grid(width, height, channels * sizeof(T), chain_halo, (int) plans.size() + 1,
+                         plans.back()->rowAlignment());
+        grid.tile_w = width;
+        grid.cols = 1;
+    } else {
+        grid = tile_grid(width, height, channels * sizeof(T), halo, chain ? 2 : (int) plans.size() + 1, align);
     }
 
-    void applySharpen() {
-        const float kernel[3][3] = {
-            {0, -1, 0},
-            {-1, 5, -1},
-            {0, -1, 0}
-        };
-        applyKernel(kernel);
+    const char* ext = (channels == 3) ? ".ppm" : ".pgm";
+    vector<string> labels;
+    if (chain) {
+        string joined;
+        for (const string& name : names) joined += (joined.empty() ? "" : "_") + name;
+        labels.push_back(joined);
+    } else {
+        labels = names;
     }
-};
+
+    vector<T*> results(labels.size(), nullptr);
+    T* spare = nullptr;
+    bool ok = true;
+    for (T*& result : results) ok = ok && (result = alloc_result(img)) != nullptr;
+    if (ok && chain && wrap && plans.size() > 1) ok = (spare = alloc_result(img)) != nullptr;
+
+    // Con varios nodos NUMA la fuente se copia a un buffer tocado por los
+    // hilos que la van a leer, y las salidas se inicializan igual.
+    int nodes = numa_nodes();
+    const T* pixels = img.getPixels();
+    T* local = nullptr;
+    if (ok && nodes > 1) {
+        local = alloc_result(img);
+        if (local) {
+            first_touch(grid, width, height, channels, local, pixels);
+            pixels = local;
+        }
+        for (T* result : results) first_touch(grid, width, height, channels, result, (const T*) nullptr);
+        if (spare) first_touch(grid, width, height, channels, spare, (const T*) nullptr);
+    }
+
+    auto filter = [&]() {
+        ProfileScope scope(STAGE_FILTER, (1.0 + results.size()) * img.getPixelCount() * sizeof(T));
+        if (chain) runChain(pixels, width, height, grid, plans, radius, wrap, results[0], spare, pitch);
+        else runFused(pixels, width, height, grid, plans, results, pitch);
+    };
+
+    if (ok) {
+        cout << "Bloques de " << grid.tile_w << "x" << grid.tile_h << " (" << grid.count() << "), "
+             << "schedule " << opt.schedule << ", " << omp_get_max_threads() << " hilos, "
+             << nodes << " nodo(s) NUMA" << endl;
+
+        // --scaling: tiempo de filtrado (sin E/S) de 1 hilo a todos, mejor
+        // de 3. La ultima pasada (todos los hilos) deja las salidas.
+        if (opt.scaling) {
+            const int max_threads = omp_get_max_threads();
+            vector<int> counts;
+            for (int t = 1; t < max_threads; t *= 2) counts.push_back(t);
+            counts.push_back(max_threads);
+            double base = 0.0;
+            printf("%6s %12s %10s %10s\n", "hilos", "tiempo (s)", "speedup", "eficiencia");
+            for (int t : counts) {
+                omp_set_num_threads(t);
+                double best = 0.0;
+                for (int rep = 0; rep < 3; rep++) {
+                    double start = omp_get_wtime();
+                    filter();
+                    double elapsed = omp_get_wtime() - start;
+                    if (rep == 0 || elapsed < best) best = elapsed;
+                }
+                if (t == 1) base = best;
+                printf("%6d %12.4f %10.2f %9.0f%%\n", t, best, base / best, 100.0 * base / best / t);
+            }
+            fflush(stdout);
+        } else {
+            double start = omp_get_wtime();
+            filter();
+            cout << "Tiempo de filtrado: " << omp_get_wtime() - start << " s" << endl;
+        }
+    }
+
+    for (size_t i = 0; i < results.size() && ok; i++) {
+        char out_name[256];
+        snprintf(out_name, sizeof(out_name), "%s_%s%s", output_prefix, labels[i].c_str(), ext);
+        if (writer) {
+            writer->submit(out_name, img.getMagic(), width, height, img.getMaxColor(), results[i], img.getPixelCount());
+        } else if (!save_pnm(out_name, img.getMagic(), width, height, img.getMaxColor(), results[i],
+                             img.getPixelCount())) {
+            ok = false;
+            continue;
+        }
+        cout << "Filtro " << labels[i] << " aplicado y guardado en " << out_name << endl;
+    }
+    for (T* result : results) free(result);
+    free(spare);
+    free(local);
+    return ok ? 0 : 1;
+}
 
 int main(int argc, char* argv[]) {
+    // Modo lote: las banderas empiezan en argv[1]. Calcula con un pool de
+    // tantos hilos como el equipo de OpenMP (OMP_NUM_THREADS o --threads).
+    if (argc > 1 && strncmp(argv[1], "--", 2) == 0) return batch_main(argc, argv, true, omp_get_max_threads());
+
     if (argc < 3) {
-        cout << "Uso: " << argv[0] << " <input_image> <output_prefix>\n";
+        cout << "Uso: " << argv[0] << " <input_image> <output_prefix> [--f f1,f2,...|--chain f1>f2>...] [--schedule static|dynamic|guided] [--pin] [--scaling] [--async-write] [--kernel <fichero>] [--radius N] [--border modo] [--precision fixed|float] [--algo auto|direct|separable|fft] [--profile] [--profile-json fichero]\n";
+        cout << "Sin --f ni --chain aplica blur, laplace y sharpen\n";
+        cout << "Lote: " << argv[0] << " --input-dir dir|--list fichero --output-dir dir --f <filtro>|--kernel <fichero> [--glob patron] [--readers N] [--writers N] [--memory-mb N] [--threads N] [opciones]\n";
         return 1;
     }
 
     const char* input_file = argv[1];
     const char* output_prefix = argv[2];
 
-    char out_blur[256], out_laplace[256], out_sharpen[256];
+    // Con --async-write un hilo dedicado escribe las salidas mientras el
+    // resto sigue.
+    FilterOptions opt;
+    if (!parse_filter_options(argc, argv, 3, opt)) return 1;
+    if (opt.chain && opt.kernel_file) {
+        cerr << "Error: --chain no se puede combinar con --kernel" << endl;
+        return 1;
+    }
+    if (!opt.schedule) opt.schedule = "static";
+    // Antes de crear el equipo de OpenMP: el hilo principal abre sus
+    // contadores aqui y los demas al entrar en los bucles de filtrado.
+    if (opt.profile) profiler().enable();
+    if (!set_schedule(opt.schedule)) {
+        cerr << "Error: --schedule espera static, dynamic o guided" << endl;
+        return 1;
+    }
+    if (opt.pin) pin_threads();
 
-    clock_t start_time = clock();
+    PNMAsyncWriter* writer = opt.async_write ? new PNMAsyncWriter() : nullptr;
 
-    #pragma omp parallel sections
-    {
-        #pragma omp section
-        {
-            PNMImage img;
-            if (img.load(input_file)) {
-                const char* ext = (strcmp(img.getMagic(), "P3") == 0) ? ".ppm" : ".pgm";
-                snprintf(out_blur, sizeof(out_blur), "%s_blur%s", output_prefix, ext);
-                img.applyBlur();
-                img.save(out_blur);
-                cout << "Filtro blur aplicado y guardado en " << out_blur << endl;
-            }
-        }
+    PNMHeader header;
+    if (!pnm_peek_header(input_file, header)) {
+        delete writer;
+        return 1;
+    }
 
-        #pragma omp section
-        {
-            PNMImage img;
-            if (img.load(input_file)) {
-                const char* ext = (strcmp(img.getMagic(), "P3") == 0) ? ".ppm" : ".pgm";
-                snprintf(out_laplace, sizeof(out_laplace), "%s_laplace%s", output_prefix, ext);
-                img.applyLaplace();
-                img.save(out_laplace);
-                cout << "Filtro laplace aplicado y guardado en " << out_laplace << endl;
-            }
-        }
+    // Tiempo real; clock() sumaria la CPU de todos los hilos.
+    double start_time = omp_get_wtime();
 
-        #pragma omp section
-        {
-            PNMImage img;
-            if (img.load(input_file)) {
-                const char* ext = (strcmp(img.getMagic(), "P3") == 0) ? ".ppm" : ".pgm";
-                snprintf(out_sharpen, sizeof(out_sharpen), "%s_sharpen%s", output_prefix, ext);
-                img.applySharpen();
-                img.save(out_sharpen);
-                cout << "Filtro sharpen aplicado y guardado en " << out_sharpen << endl;
-            }
-        }
+    int status = (header.max_color > 255) ? run<uint16_t>(input_file, output_prefix, opt, writer)
+                                          : run<uint8_t>(input_file, output_prefix, opt, writer);
+
+    if (writer) {
+        if (!writer->finish()) status = 1;
+        delete writer;
     }
 
-    clock_t end_time = clock();
-    double cpu_time = double(end_time - start_time) / CLOCKS_PER_SEC;
-    cout << "Tiempo total con OpenMP: " << cpu_time << " segundos" << endl;
+    cout << "Tiempo total con OpenMP: " << omp_get_wtime() - start_time << " segundos" << endl;
+    profile_finish(argv[0], opt.profile_json);
 
-    return 0;
+    return status;
 }
@@ -0,0 +1,386 @@
+#ifndef FILTERS_H
+#define FILTERS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include "convolve_simd.h"
+
+// Filtros 3x3 predefinidos como tipos constexpr: taps enteros y un divisor.
+// static_filter_interior se instancia por filtro, tipo de muestra y numero
+// de canales, asi que los taps en 0 desaparecen, los +-1 quedan como
+// suma/resta, las potencias de 2 como desplazamiento y el salto al vecino
+// (+-CH) es constante.
+
+struct BlurFilter {
+    static constexpr const char* name = "blur";
+    static constexpr int taps[3][3] = {
+        {1, 1, 1},
+        {1, 1, 1},
+        {1, 1, 1}
+    };
+    static constexpr int divisor = 9;
+};
+
+struct LaplaceFilter {
+    static constexpr const char* name = "laplace";
+    static constexpr int taps[3][3] = {
+        {0, -1, 0},
+        {-1, 4, -1},
+        {0, -1, 0}
+    };
+    static constexpr int divisor = 1;
+};
+
+struct SharpenFilter {
+    static constexpr const char* name = "sharpen";
+    static constexpr int taps[3][3] = {
+        {0, -1, 0},
+        {-1, 5, -1},
+        {0, -1, 0}
+    };
+    static constexpr int divisor = 1;
+};
+
+// Gradiente horizontal de Sobel.
+struct SobelFilter {
+    static constexpr const char* name = "sobel";
+    static constexpr int taps[3][3] = {
+        {-1, 0, 1},
+        {-2, 0, 2},
+        {-1, 0, 1}
+    };
+    static constexpr int divisor = 1;
+};
+
+struct EmbossFilter {
+    static constexpr const char* name = "emboss";
+    static constexpr int taps[3][3] = {
+        {-2, -1, 0},
+        {-1, 1, 1},
+        {0, 1, 2}
+    };
+    static constexpr int divisor = 1;
+};
+
+
+template <typename F>
+constexpr int static_filter_abs_sum() {
+    int sum = 0;
+    for (int t = 0; t < 9; t++) sum += (F::taps[t / 3][t % 3] < 0) ? -F::taps[t / 3][t % 3] : F::taps[t / 3][t % 3];
+    return sum;
+}
+
+template <typename F>
+constexpr bool static_filter_nonnegative() {
+    for (int t = 0; t < 9; t++) {
+        if (F::taps[t / 3][t % 3] < 0) return false;
+    }
+    return true;
+}
+
+// x / divisor como (x * magic) >> 16, comprobado para todo x posible en 8 bits.
+template <typename F>
+constexpr int static_filter_magic() {
+    return (65536 + F::divisor - 1) / F::divisor;
+}
+
+template <typename F>
+constexpr bool static_filter_magic_exact() {
+    const int max_acc = 255 * static_filter_abs_sum<F>() + F::divisor / 2;
+    for (int x = 0; x <= max_acc; x++) {
+        if (((long long) x * static_filter_magic<F>()) >> 16 != x / F::divisor) return false;
+    }
+    return true;
+}
+
+// Las variantes vectoriales de 8 bits acumulan en int16 y dividen con mulhi.
+template <typename F>
+constexpr bool static_filter_simd8() {
+    return 255 * static_filter_abs_sum<F>() + F::divisor / 2 <= 32767 &&
+           (F::divisor == 1 || (static_filter_nonnegative<F>() && static_filter_magic_exact<F>()));
+}
+
+constexpr int static_log2(int k) {
+    return (k <= 1) ? 0 : 1 + static_log2(k / 2);
+}
+
+template <int K>
+constexpr bool static_is_pow2() {
+    return K > 1 && (K & (K - 1)) == 0;
+}
+
+
+// Suma del tap I (fila I/3, columna I%3) resuelta en compilacion.
+template <typename F, int CH, int I, typename T>
+inline void static_filter_tap(const T* const rows[3], int i, int& acc) {
+    constexpr int k = F::taps[I / 3][I % 3];
+    if constexpr (k != 0) {
+        int v = rows[I / 3][i + (I % 3 - 1) * CH];
+        if constexpr (k == 1) acc += v;
+        else if constexpr (k == -1) acc -= v;
+        else if constexpr (static_is_pow2<k>()) acc += v << static_log2(k);
+        else acc += k * v;
+    }
+}
+
+template <typename F, int CH, typename T, std::size_t... I>
+inline int static_filter_sum(const T* const rows[3], int i, std::index_sequence<I...>) {
+    int acc = 0;
+    (static_filter_tap<F, CH, (int) I>(rows, i, acc), ...);
+    return acc;
+}
+
+template <typename F, int CH, typename T>
+inline void static_filter_row(const T* const rows[3], int i0, int i1, T* out, int max_color, int bias) {
+    for (int i = i0; i < i1; i++) {
+        int acc = static_filter_sum<F, CH>(rows, i, std::make_index_sequence<9>());
+        int result = (acc + bias) / F::divisor;
+        out[i] = (T) (result < 0 ? 0 : (result > max_color ? max_color : result));
+    }
+}
+
+// Interior [x0, x1) x [y0, y1) (los 9 vecinos dentro de la imagen). Con
+// taps enteros el resultado es exacto: trunca, o redondea con round_nearest.
+template <typename F, int CH, typename T>
+void static_filter_interior(const T* src, int width, int x0, int x1, int y0, int y1,
+                            T* dst, size_t dst_pitch, int max_color, bool round_nearest) {
+    const size_t row_len = (size_t) width * CH;
+    const int bias = round_nearest ? F::divisor / 2 : 0;
+
+    for (int y = y0; y < y1; y++) {
+        const T* mid = src + (size_t) y * row_len;
+        const T* const rows[3] = {mid - row_len, mid, mid + row_len};
+        static_filter_row<F, CH>(rows, x0 * CH, x1 * CH, dst + (size_t) (y - y0) * dst_pitch, max_color, bias);
+    }
+}
+
+
+#if defined(CONV_SIMD_X86)
+
+template <typename F, int CH, int I>
+__attribute__((target("avx2")))
+inline void static_filter_tap_avx2(const uint8_t* const rows[3], int i, __m256i& acc) {
+    constexpr int k = F::taps[I / 3][I % 3];
+    if constexpr (k != 0) {
+        const uint8_t* p = rows[I / 3] + i + (I % 3 - 1) * CH;
+        __m256i v = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) p));
+        if constexpr (k == 1) acc = _mm256_add_epi16(acc, v);
+        else if constexpr (k == -1) acc = _mm256_sub_epi16(acc, v);
+        else if constexpr (static_is_pow2<k>()) acc = _mm256_add_epi16(acc, _mm256_slli_epi16(v, static_log2(k)));
+        else acc = _mm256_add_epi16(acc, _mm256_mullo_epi16(v, _mm256_set1_epi16(k)));
+    }
+}
+
+template <typename F, int CH, std::size_t... I>
+__attribute__((target("avx2")))
+inline __m256i static_filter_sum_avx2(const uint8_t* const rows[3], int i, __m256i acc, std::index_sequence<I...>) {
+    (static_filter_tap_avx2<F, CH, (int) I>(rows, i, acc), ...);
+    return acc;
+}
+
+// 16 muestras por vector en int16.
+template <typename F, int CH>
+__attribute__((target("avx2")))
+void static_filter_interior_avx2(const uint8_t* src, int width, int x0, int x1, int y0, int y1,
+                                 uint8_t* dst, size_t dst_pitch, int max_color, bool round_nearest) {
+    const size_t row_len = (size_t) width * CH;
+    const int bias = round_nearest ? F::divisor / 2 : 0;
+    const int i0 = x0 * CH, i1 = x1 * CH;
+    const __m256i vbias = _mm256_set1_epi16((int16_t) bias);
+    const __m256i magic = _mm256_set1_epi16((int16_t) static_filter_magic<F>());
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i maxc = _mm256_set1_epi16((int16_t) max_color);
+
+    for (int y = y0; y < y1; y++) {
+        const uint8_t* mid = src + (size_t) y * row_len;
+        const uint8_t* const rows[3] = {mid - row_len, mid, mid + row_len};
+        uint8_t* out = dst + (size_t) (y - y0) * dst_pitch;
+        int i = i0;
+        for (; i + 16 <= i1; i += 16) {
+            __m256i acc = static_filter_sum_avx2<F, CH>(rows, i, vbias, std::make_index_sequence<9>());
+            if constexpr (F::divisor > 1) acc = _mm256_mulhi_epu16(acc, magic);
+            acc = _mm256_min_epi16(_mm256_max_epi16(acc, zero), maxc);
+            __m256i bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(acc, acc), 0x08);
+            _mm_storeu_si128((__m128i*) (out + i), _mm256_castsi256_si128(bytes));
+        }
+        static_filter_row<F, CH>(rows, i, i1, out, max_color, bias);
+    }
+}
+
+
+template <typename F, int CH, int I>
+__attribute__((target("sse4.1")))
+inline void static_filter_tap_sse41(const uint8_t* const rows[3], int i, __m128i& acc) {
+    constexpr int k = F::taps[I / 3][I % 3];
+    if constexpr (k != 0) {
+        const uint8_t* p = rows[I / 3] + i + (I % 3 - 1) * CH;
+        __m128i v = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*) p));
+        if constexpr (k == 1) acc = _mm_add_epi16(acc, v);
+        else if constexpr (k == -1) acc = _mm_sub_epi16(acc, v);
+        else if constexpr (static_is_pow2<k>()) acc = _mm_add_epi16(acc, _mm_slli_epi16(v, static_log2(k)));
+        else acc = _mm_add_epi16(acc, _mm_mullo_epi16(v, _mm_set1_epi16(k)));
+    }
+}
+
+template <typename F, int CH, std::size_t... I>
+__attribute__((target("sse4.1")))
+inline __m128i static_filter_sum_sse41(const uint8_t* const rows[3], int i, __m128i acc, std::index_sequence<I...>) {
+    (static_filter_tap_sse41<F, CH, (int) I>(rows, i, acc), ...);
+    return acc;
+}
+
+// 8 muestras por vector en int16.
+template <typename F, int CH>
+__attribute__((target("sse4.1")))
+void static_filter_interior_sse41(const uint8_t* src, int width, int x0, int x1, int y0, int y1,
+                                  uint8_t* dst, size_t dst_pitch, int max_color, bool round_nearest) {
+    const size_t row_len = (size_t) width * CH;
+    const int bias = round_nearest ? F::divisor / 2 : 0;
+    const int i0 = x0 * CH, i1 = x1 * CH;
+    const __m128i vbias = _mm_set1_epi16((int16_t) bias);
+    const __m128i magic = _mm_set1_epi16((int16_t) static_filter_magic<F>());
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i maxc = _mm_set1_epi16((int16_t) max_color);
+
+    for (int y = y0; y < y1; y++) {
+        const uint8_t* mid = src + (size_t) y * row_len;
+        const uint8_t* const rows[3] = {mid - row_len, mid, mid + row_len};
+        uint8_t* out = dst + (size_t) (y - y0) * dst_pitch;
+        int i = i0;
+        for (; i + 8 <= i1; i += 8) {
+            __m128i acc = static_filter_sum_sse41<F, CH>(rows, i, vbias, std::make_index_sequence<9>());
+            if constexpr (F::divisor > 1) acc = _mm_mulhi_epu16(acc, magic);
+            acc = _mm_min_epi16(_mm_max_epi16(acc, zero), maxc);
+            _mm_storel_epi64((__m128i*) (out + i), _mm_packus_epi16(acc, acc));
+        }
+        static_filter_row<F, CH>(rows, i, i1, out, max_color, bias);
+    }
+}
+
+#endif  // CONV_SIMD_X86
+
+
+#if defined(CONV_SIMD_NEON)
+
+template <typename F, int CH, int I>
+inline void static_filter_tap_neon(const uint8_t* const rows[3], int i, int16x8_t& acc) {
+    constexpr int k = F::taps[I / 3][I % 3];
+    if constexpr (k != 0) {
+        int16x8_t v = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(rows[I / 3] + i + (I % 3 - 1) * CH)));
+        if constexpr (k == 1) acc = vaddq_s16(acc, v);
+        else if constexpr (k == -1) acc = vsubq_s16(acc, v);
+        else if constexpr (static_is_pow2<k>()) acc = vaddq_s16(acc, vshlq_n_s16(v, static_log2(k)));
+        else acc = vmlaq_n_s16(acc, v, (int16_t) k);
+    }
+}
+
+template <typename F, int CH, std::size_t... I>
+inline int16x8_t static_filter_sum_neon(const uint8_t* const rows[3], int i, int16x8_t acc, std::index_sequence<I...>) {
+    (static_filter_tap_neon<F, CH, (int) I>(rows, i, acc), ...);
+    return acc;
+}
+
+template <typename F, int CH>
+void static_filter_interior_neon(const uint8_t* src, int width, int x0, int x1, int y0, int y1,
+                                 uint8_t* dst, size_t dst_pitch, int max_color, bool round_nearest) {
+    const size_t row_len = (size_t) width * CH;
+    const int bias = round_nearest ? F::divisor / 2 : 0;
+    const int i0 = x0 * CH, i1 = x1 * CH;
+    const int16x8_t vbias = vdupq_n_s16((int16_t) bias);
+    const uint16x4_t magic = vdup_n_u16((uint16_t) static_filter_magic<F>());
+    const int16x8_t zero = vdupq_n_s16(0);
+    const int16x8_t maxc = vdupq_n_s16((int16_t) max_color);
+
+    for (int y = y0; y < y1; y++) {
+        const uint8_t* mid = src + (size_t) y * row_len;
+        const uint8_t* const rows[3] = {mid - row_len, mid, mid + row_len};
+        uint8_t* out = dst + (size_t) (y - y0) * dst_pitch;
+        int i = i0;
+        for (; i + 8 <= i1; i += 8) {
+            int16x8_t acc = static_filter_sum_neon<F, CH>(rows, i, vbias, std::make_index_sequence<9>());
+            if constexpr (F::divisor > 1) {
+                uint16x8_t u = vreinterpretq_u16_s16(acc);
+                uint16x4_t lo = vshrn_n_u32(vmull_u16(vget_low_u16(u), magic), 16);
+                uint16x4_t hi = vshrn_n_u32(vmull_u16(vget_high_u16(u), magic), 16);
+                acc = vreinterpretq_s16_u16(vcombine_u16(lo, hi));
+            }
+            vst1_u8(out + i, vqmovun_s16(vminq_s16(vmaxq_s16(acc, zero), maxc)));
+        }
+        static_filter_row<F, CH>(rows, i, i1, out, max_color, bias);
+    }
+}
+
+#endif  // CONV_SIMD_NEON
+
+
+template <typename T>
+struct StaticFilter {
+    typedef void (*Fn)(const T* src, int width, int x0, int x1, int y0, int y1,
+                       T* dst, size_t dst_pitch, int max_color, bool round_nearest);
+
+    const char* name;
+    Fn gray;        // 1 canal
+    Fn rgb;         // 3 canales
+    ConvIsa isa;
+    int taps[9];    // para el marco
+    int divisor;
+};
+
+// Variante de la instanciacion segun la CPU; las vectoriales solo existen
+// para 8 bits y kernels que caben en int16.
+template <typename F, int CH, typename T>
+typename StaticFilter<T>::Fn static_filter_select(ConvIsa isa) {
+    if constexpr (sizeof(T) == 1 && static_filter_simd8<F>()) {
+        switch (isa) {
+#if defined(CONV_SIMD_X86)
+            case CONV_ISA_AVX2: return static_filter_interior_avx2<F, CH>;
+            case CONV_ISA_SSE41: return static_filter_interior_sse41<F, CH>;
+#elif defined(CONV_SIMD_NEON)
+            case CONV_ISA_NEON: return static_filter_interior_neon<F, CH>;
+#endif
+            default: break;
+        }
+    }
+    (void) isa;
+    return static_filter_interior<F, CH, T>;
+}
+
+template <typename F, typename T>
+StaticFilter<T> static_filter_entry() {
+    StaticFilter<T> f;
+    f.name = F::name;
+    f.isa = (sizeof(T) == 1 && static_filter_simd8<F>()) ? conv_simd_isa() : CONV_ISA_SCALAR;
+    f.gray = static_filter_select<F, 1, T>(f.isa);
+    f.rgb = static_filter_select<F, 3, T>(f.isa);
+    for (int t = 0; t < 9; t++) f.taps[t] = F::taps[t / 3][t % 3];
+    f.divisor = F::divisor;
+    return f;
+}
+
+// Tabla nombre -> instanciaciones; nullptr si el nombre no es un filtro
+// predefinido.
+template <typename T>
+const StaticFilter<T>* find_static_filter(const char* name) {
+    static const StaticFilter<T> table[] = {
+        static_filter_entry<BlurFilter, T>(),
+        static_filter_entry<LaplaceFilter, T>(),
+        static_filter_entry<SharpenFilter, T>(),
+        static_filter_entry<SobelFilter, T>(),
+        static_filter_entry<EmbossFilter, T>()
+    };
+    if (!name) return nullptr;
+    for (const auto& f : table) {
+        if (strcmp(f.name, name) == 0) return &f;
+    }
+    return nullptr;
+}
+
+// Pesos en float del filtro F (taps / divisor) por filas.
+template <typename F>
+void static_filter_weights(float out[9]) {
+    for (int t = 0; t < 9; t++) out[t] = (float) F::taps[t / 3][t % 3] / F::divisor;
+}
+
+#endif
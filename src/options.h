@@ -0,0 +1,167 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include "convolve.h"
+#include "pnmfilter.h"
+
+const int MAX_THREADS = 256;
+
+// Banderas de linea de comandos comunes a todos los filtros.
+struct FilterOptions {
+    const char* filter;   // --f <nombre> (filtro_omp: lista a,b,c)
+    const char* chain;    // --chain a>b>c (filtro_omp)
+    const char* kernel_file;  // --kernel <fichero>: kernel N x N de usuario
+    int radius;           // --radius N (blur de (2N+1)x(2N+1))
+    bool async_write;     // --async-write
+    BorderMode border;    // --border clamp|mirror|wrap|zero|renormalize
+    ConvPrecision precision;  // --precision fixed|float
+    int algorithm;        // --algo auto|direct|separable|fft (-1: auto)
+    int threads;          // --threads N (0: uno por nucleo)
+    FilterBackend backend;  // --backend serial|openmp|threads|mpi (filtro)
+    const char* schedule; // --schedule static|dynamic|guided (filtro_omp; nullptr: static)
+    bool pin;             // --pin: fija cada hilo a una CPU (filtro_omp)
+    bool scaling;         // --scaling: tiempos de 1 hilo a todos (filtro_omp)
+    bool root_io;         // --root-io: E/S solo en rank 0 (mpi_filterer)
+    bool dynamic;         // --dynamic: maestro/trabajador por bloques (mpi_filterer)
+    const char* input_dir;  // modo lote (batch.h): --input-dir, --output-dir,
+    const char* output_dir; // --glob patron o --list fichero
+    const char* glob;
+    const char* list_file;
+    int readers, writers; // --readers N, --writers N
+    int memory_mb;        // --memory-mb N: imagenes en vuelo del lote
+    bool stream;          // --stream: lee y escribe por filas (filtro)
+    bool profile;         // --profile: tiempo por etapa (profile.h)
+    const char* profile_json;  // --profile-json fichero (implica --profile)
+
+    FilterOptions() : filter(nullptr), chain(nullptr), kernel_file(nullptr), radius(1), async_write(false),
+                      border(BORDER_RENORMALIZE), precision(PRECISION_FLOAT), algorithm(-1), threads(0), backend(BACKEND_SERIAL), schedule(nullptr),
+                      pin(false), scaling(false), root_io(false), dynamic(false),
+                      input_dir(nullptr), output_dir(nullptr), glob(nullptr), list_file(nullptr),
+                      readers(2), writers(2), memory_mb(512), stream(false),
+                      profile(false), profile_json(nullptr) {}
+
+    ConvOptions convOptions() const {
+        ConvOptions conv;
+        conv.border = border;
+        conv.precision = precision;
+        conv.algorithm = algorithm;
+        return conv;
+    }
+
+    // Nombre con el que se informa y se etiquetan las salidas.
+    const char* filterName() const { return kernel_file ? "kernel" : filter; }
+};
+
+
+// Kernel de --kernel si se dio; si no, el filtro predefinido name. Avisa
+// por cerr si falla.
+inline bool load_filter_kernel(const char* name, const FilterOptions& opt, Kernel& kernel) {
+    if (opt.kernel_file) return load_kernel_file(opt.kernel_file, kernel);
+    if (filter_kernel(name, opt.radius, kernel)) return true;
+    filter_kernel_error(name, opt.radius);
+    return false;
+}
+
+
+inline bool parse_int_option(const char* flag, const char* text, int min_value, int max_value, int& out) {
+    char* end = nullptr;
+    long value = strtol(text, &end, 10);
+    if (!text[0] || *end != '\0' || value < min_value || value > max_value) {
+        std::cerr << "Error: " << flag << " espera un entero entre " << min_value
+                  << " y " << max_value << std::endl;
+        return false;
+    }
+    out = (int) value;
+    return true;
+}
+
+
+// Lee las banderas desde argv[first] en adelante.
+inline bool parse_filter_options(int argc, char* argv[], int first, FilterOptions& opt) {
+    for (int i = first; i < argc; i++) {
+        const char* arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (strcmp(arg, "--f") == 0 && has_value) {
+            opt.filter = argv[++i];
+        } else if (strcmp(arg, "--chain") == 0 && has_value) {
+            opt.chain = argv[++i];
+        } else if (strcmp(arg, "--kernel") == 0 && has_value) {
+            opt.kernel_file = argv[++i];
+        } else if (strcmp(arg, "--algo") == 0 && has_value) {
+            const char* value = argv[++i];
+            if (strcmp(value, "auto") == 0) opt.algorithm = -1;
+            else if (strcmp(value, "direct") == 0) opt.algorithm = CONV_DIRECT;
+            else if (strcmp(value, "separable") == 0) opt.algorithm = CONV_SEPARABLE;
+            else if (strcmp(value, "fft") == 0) opt.algorithm = CONV_FFT;
+            else {
+                std::cerr << "Error: --algo espera auto, direct, separable o fft" << std::endl;
+                return false;
+            }
+        } else if (strcmp(arg, "--radius") == 0 && has_value) {
+            if (!parse_int_option(arg, argv[++i], 1, MAX_BLUR_RADIUS, opt.radius)) return false;
+        } else if (strcmp(arg, "--threads") == 0 && has_value) {
+            if (!parse_int_option(arg, argv[++i], 1, MAX_THREADS, opt.threads)) return false;
+        } else if (strcmp(arg, "--backend") == 0 && has_value) {
+            if (!parse_backend(argv[++i], opt.backend)) {
+                std::cerr << "Error: --backend espera serial, openmp, threads o mpi" << std::endl;
+                return false;
+            }
+        } else if (strcmp(arg, "--border") == 0 && has_value) {
+            if (!parse_border_mode(argv[++i], opt.border)) {
+                std::cerr << "Error: --border espera clamp, mirror, wrap, zero o renormalize" << std::endl;
+                return false;
+            }
+        } else if (strcmp(arg, "--precision") == 0 && has_value) {
+            const char* value = argv[++i];
+            if (strcmp(value, "fixed") == 0) opt.precision = PRECISION_FIXED;
+            else if (strcmp(value, "float") == 0) opt.precision = PRECISION_FLOAT;
+            else {
+                std::cerr << "Error: --precision espera fixed o float" << std::endl;
+                return false;
+            }
+        } else if (strcmp(arg, "--schedule") == 0 && has_value) {
+            opt.schedule = argv[++i];
+        } else if (strcmp(arg, "--pin") == 0) {
+            opt.pin = true;
+        } else if (strcmp(arg, "--scaling") == 0) {
+            opt.scaling = true;
+        } else if (strcmp(arg, "--root-io") == 0) {
+            opt.root_io = true;
+        } else if (strcmp(arg, "--dynamic") == 0) {
+            opt.dynamic = true;
+        } else if (strcmp(arg, "--input-dir") == 0 && has_value) {
+            opt.input_dir = argv[++i];
+        } else if (strcmp(arg, "--output-dir") == 0 && has_value) {
+            opt.output_dir = argv[++i];
+        } else if (strcmp(arg, "--glob") == 0 && has_value) {
+            opt.glob = argv[++i];
+        } else if (strcmp(arg, "--list") == 0 && has_value) {
+            opt.list_file = argv[++i];
+        } else if (strcmp(arg, "--readers") == 0 && has_value) {
+            if (!parse_int_option(arg, argv[++i], 1, 64, opt.readers)) return false;
+        } else if (strcmp(arg, "--writers") == 0 && has_value) {
+            if (!parse_int_option(arg, argv[++i], 1, 64, opt.writers)) return false;
+        } else if (strcmp(arg, "--memory-mb") == 0 && has_value) {
+            if (!parse_int_option(arg, argv[++i], 1, 1 << 20, opt.memory_mb)) return false;
+        } else if (strcmp(arg, "--stream") == 0) {
+            opt.stream = true;
+        } else if (strcmp(arg, "--profile") == 0) {
+            opt.profile = true;
+        } else if (strcmp(arg, "--profile-json") == 0 && has_value) {
+            opt.profile = true;
+            opt.profile_json = argv[++i];
+        } else if (strcmp(arg, "--async-write") == 0) {
+            opt.async_write = true;
+        } else {
+            std::cerr << "Opcion no reconocida o incompleta: " << arg << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef PNM_IMAGE_H
+#define PNM_IMAGE_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include "pnm_io.h"
+
+// Imagen PNM con muestras compactas: T = uint8_t para maxval <= 255 y
+// uint16_t para maxval <= 65535. Un P5/P6 de 8 bits se usa directamente desde
+// el mapeo copy-on-write del archivo, sin copiar ni interpretar pixeles.
+template <typename T>
+class PNMImage {
+private:
+    char magic[3];
+    int width;
+    int height;
+    int max_color;
+    T* pixels;
+    int pixel_count;
+    bool owns_pixels;     // false si pixels apunta dentro de map
+    MappedFile map;
+    PNMReadStats read_stats;
+
+    PNMImage(const PNMImage&) = delete;
+    PNMImage& operator=(const PNMImage&) = delete;
+
+    void release() {
+        if (pixels && owns_pixels) free(pixels);
+        pixels = nullptr;
+        owns_pixels = false;
+        map.close();
+    }
+
+public:
+    PNMImage() : width(0), height(0), max_color(0), pixels(nullptr), pixel_count(0),
+                 owns_pixels(false), read_stats() {
+        magic[0] = '\0';
+    }
+
+    ~PNMImage() {
+        release();
+    }
+
+    bool load(const char* filename) {
+        ProfileScope scope(STAGE_PARSE);
+        auto t0 = std::chrono::steady_clock::now();
+        release();
+
+        if (!map.open(filename, true)) {
+            std::cerr << "Error: no se pudo abrir " << filename << std::endl;
+            return false;
+        }
+
+        PNMHeader h;
+        if (!pnm_parse_header(map.data(), map.size(), h)) return false;
+        scope.addBytes(map.size());
+        if (h.max_color > (int) (T) ~0u) {
+            std::cerr << "Error: max_color " << h.max_color << " no cabe en "
+                      << sizeof(T) * 8 << " bits" << std::endl;
+            return false;
+        }
+
+        strcpy(magic, h.magic);
+        width = h.width;
+        height = h.height;
+        max_color = h.max_color;
+        pixel_count = width * height * h.channels;
+
+        size_t payload = (size_t) pixel_count * pnm_sample_bytes(max_color);
+        if (h.binary && sizeof(T) == 1 && map.size() - h.data_offset >= payload) {
+            pixels = (T*) (map.data() + h.data_offset);
+            owns_pixels = false;
+        } else {
+            scope.pause();
+            {
+                ProfileScope alloc(STAGE_ALLOCATE, (double) pixel_count * sizeof(T));
+                pixels = (T*) malloc((size_t) pixel_count * sizeof(T));
+            }
+            scope.resume();
+            if (!pixels) {
+                std::cerr << "Error reservando memoria" << std::endl;
+                return false;
+            }
+            owns_pixels = true;
+
+            if (!h.binary) madvise(map.data(), map.size(), MADV_WILLNEED);
+            bool ok = pnm_read_pixels(map.data(), map.size(), h, pixels);
+            map.close();
+            if (!ok) {
+                release();
+                return false;
+            }
+        }
+
+        read_stats.bytes = owns_pixels ? h.data_offset + payload : map.size();
+        read_stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        read_stats.ascii = !h.binary;
+        return true;
+    }
+
+    bool save(const char* filename) const {
+        return save_pnm(filename, magic, width, height, max_color, pixels, pixel_count);
+    }
+
+    void saveAsync(PNMAsyncWriter& writer, const char* filename) const {
+        writer.submit(filename, magic, width, height, max_color, pixels, pixel_count);
+    }
+
+    // Reemplaza las muestras por un buffer reservado con malloc; la imagen
+    // pasa a ser su duena.
+    void setPixels(T* new_pixels) {
+        release();
+        pixels = new_pixels;
+        owns_pixels = true;
+    }
+
+    // Cambia entre P2/P3 (ASCII) y P5/P6 (binario) para la siguiente escritura.
+    void setBinary(bool binary) {
+        int channels = pnm_channels(magic);
+        if (binary) strcpy(magic, (channels == 3) ? "P6" : "P5");
+        else strcpy(magic, (channels == 3) ? "P3" : "P2");
+    }
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    int getChannels() const { return pnm_channels(magic); }
+    int getMaxColor() const { return max_color; }
+    int getPixelCount() const { return pixel_count; }
+    T* getPixels() { return pixels; }
+    const T* getPixels() const { return pixels; }
+    const char* getMagic() const { return magic; }
+    const PNMReadStats& getReadStats() const { return read_stats; }
+};
+
+#endif
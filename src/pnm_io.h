@@ -0,0 +1,624 @@
+#ifndef PNM_IO_H
+#define PNM_IO_H
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "profile.h"
+
+// Lectura/escritura de imagenes PNM compartida por todos los filtros.
+// Formatos soportados: P2/P3 (ASCII) y P5/P6 (binario, maxval de 8 o 16 bits).
+
+
+// Archivo completo mapeado en memoria. Con writable = true el mapeo es
+// copy-on-write (MAP_PRIVATE): se puede modificar sin tocar el archivo.
+class MappedFile {
+private:
+    unsigned char* data_;
+    size_t size_;
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+public:
+    MappedFile() : data_(nullptr), size_(0) {}
+
+    ~MappedFile() { close(); }
+
+    bool open(const char* filename, bool writable = false) {
+        close();
+        int fd = ::open(filename, O_RDONLY);
+        if (fd < 0) return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+            ::close(fd);
+            return false;
+        }
+
+        int prot = writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+        void* p = mmap(nullptr, st.st_size, prot, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) return false;
+
+        madvise(p, st.st_size, MADV_SEQUENTIAL);
+        data_ = (unsigned char*) p;
+        size_ = st.st_size;
+        return true;
+    }
+
+    void close() {
+        if (data_) munmap(data_, size_);
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    const unsigned char* data() const { return data_; }
+    unsigned char* data() { return data_; }
+    size_t size() const { return size_; }
+};
+
+
+struct PNMHeader {
+    char magic[3];
+    int width;
+    int height;
+    int max_color;
+    int channels;
+    bool binary;
+    size_t data_offset;   // primer byte de los pixeles dentro del archivo
+};
+
+
+inline int pnm_channels(const char* magic) {
+    return (strcmp(magic, "P3") == 0 || strcmp(magic, "P6") == 0) ? 3 : 1;
+}
+
+inline bool pnm_is_binary(const char* magic) {
+    return strcmp(magic, "P5") == 0 || strcmp(magic, "P6") == 0;
+}
+
+// Bytes por muestra en el formato binario (16 bits big-endian si maxval > 255).
+inline int pnm_sample_bytes(int max_color) {
+    return (max_color > 255) ? 2 : 1;
+}
+
+
+// Interpreta la cabecera "Px ancho alto maxval" desde un buffer. Los
+// comentarios '#' se aceptan entre los campos de la cabecera. Sin
+// check_size se aceptan imagenes de mas de 2^31 muestras (--stream, que
+// nunca las tiene enteras en memoria).
+inline bool pnm_parse_header(const unsigned char* buf, size_t size, PNMHeader& h, bool check_size = true) {
+    if (size < 2 || buf[0] != 'P' ||
+        (buf[1] != '2' && buf[1] != '3' && buf[1] != '5' && buf[1] != '6')) {
+        std::cerr << "Error leyendo magic number" << std::endl;
+        return false;
+    }
+    h.magic[0] = 'P';
+    h.magic[1] = (char) buf[1];
+    h.magic[2] = '\0';
+
+    size_t pos = 2;
+    int fields[3];
+    for (int f = 0; f < 3; f++) {
+        while (pos < size) {
+            if (buf[pos] == '#') {
+                while (pos < size && buf[pos] != '\n') pos++;
+            } else if (isspace(buf[pos])) {
+                pos++;
+            } else {
+                break;
+            }
+        }
+        if (pos >= size || !isdigit(buf[pos])) {
+            std::cerr << "Error leyendo cabecera PNM" << std::endl;
+            return false;
+        }
+        long value = 0;
+        while (pos < size && isdigit(buf[pos])) {
+            value = value * 10 + (buf[pos] - '0');
+            if (value > 1000000000L) {
+                std::cerr << "Error: valor de cabecera fuera de rango" << std::endl;
+                return false;
+            }
+            pos++;
+        }
+        fields[f] = (int) value;
+    }
+
+    // Tras maxval viene exactamente un caracter de espacio en blanco.
+    if (pos >= size || !isspace(buf[pos])) {
+        std::cerr << "Error leyendo max_color" << std::endl;
+        return false;
+    }
+    pos++;
+
+    h.width = fields[0];
+    h.height = fields[1];
+    h.max_color = fields[2];
+    h.channels = pnm_channels(h.magic);
+    h.binary = pnm_is_binary(h.magic);
+    h.data_offset = pos;
+
+    if (h.width <= 0 || h.height <= 0) {
+        std::cerr << "Error leyendo width/height" << std::endl;
+        return false;
+    }
+    if (h.max_color <= 0 || h.max_color > 65535) {
+        std::cerr << "Error: max_color fuera de rango (1..65535)" << std::endl;
+        return false;
+    }
+    if (check_size && (long long) h.width * h.height * h.channels > 0x7fffffffLL) {
+        std::cerr << "Error: imagen demasiado grande" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
+// Copia el payload binario (P5/P6) al buffer de muestras.
+template <typename T>
+void pnm_decode_binary(const unsigned char* src, T* pixels, int pixel_count, int max_color) {
+    if (pnm_sample_bytes(max_color) == 1) {
+        if (sizeof(T) == 1) {
+            memcpy(pixels, src, pixel_count);
+        } else {
+            for (int i = 0; i < pixel_count; i++) pixels[i] = src[i];
+        }
+    } else {
+        for (int i = 0; i < pixel_count; i++) pixels[i] = (T) ((src[2*i] << 8) | src[2*i + 1]);
+    }
+}
+
+
+// Tabla de clases de caracter para el tokenizador ASCII: 0 = digito,
+// 1 = espacio en blanco, 2 = cualquier otro caracter (incluido '#').
+struct PNMCharClass {
+    unsigned char cls[256];
+
+    PNMCharClass() {
+        for (int i = 0; i < 256; i++) cls[i] = 2;
+        for (int i = '0'; i <= '9'; i++) cls[i] = 0;
+        cls[(unsigned char) ' '] = cls[(unsigned char) '\t'] = cls[(unsigned char) '\n'] = 1;
+        cls[(unsigned char) '\r'] = cls[(unsigned char) '\v'] = cls[(unsigned char) '\f'] = 1;
+    }
+};
+
+inline const PNMCharClass& pnm_char_class() {
+    static const PNMCharClass table;
+    return table;
+}
+
+
+// Interpreta el raster de un P2/P3 desde un buffer en memoria. Segun la
+// especificacion de Netpbm los comentarios solo pueden aparecer en la
+// cabecera, asi que un '#' dentro del raster es un error.
+// Una muestra mayor que maxval tambien lo es; se comprueba antes de
+// convertirla a T, que podria truncarla (300 en uint8_t es 44).
+// Devuelve el numero de muestras leidas (== count si todo fue bien).
+template <typename T>
+int pnm_parse_ascii(const unsigned char* p, const unsigned char* end,
+                    T* pixels, int count, int max_color) {
+    const unsigned char* cls = pnm_char_class().cls;
+
+    for (int i = 0; i < count; i++) {
+        while (p < end && cls[*p] == 1) p++;
+        if (p == end || cls[*p] != 0) return i;
+
+        const unsigned char* start = p;
+        unsigned value = *p++ - '0';
+        unsigned digit;
+        while (p < end && (digit = (unsigned) (*p - '0')) <= 9) {
+            value = value * 10 + digit;
+            p++;
+        }
+        if (p - start > 5 || value > (unsigned) max_color) return i;
+        pixels[i] = (T) value;
+    }
+    return count;
+}
+
+
+struct PNMReadStats {
+    size_t bytes;      // bytes del archivo procesados
+    double seconds;    // tiempo total de lectura
+    bool ascii;
+
+    double mbPerSecond() const {
+        return (seconds > 0) ? (bytes / 1e6) / seconds : 0.0;
+    }
+};
+
+
+inline void pnm_report_read(const PNMReadStats& stats) {
+    std::cout << "Lectura " << (stats.ascii ? "ASCII" : "binaria") << ": "
+              << stats.bytes / 1e6 << " MB en " << stats.seconds << " s ("
+              << stats.mbPerSecond() << " MB/s)" << std::endl;
+}
+
+
+// Lee la cabecera sin tocar los pixeles; sirve para elegir el tipo de
+// muestra (uint8_t si maxval <= 255, uint16_t si no) antes de cargar.
+inline bool pnm_peek_header(const char* filename, PNMHeader& h, bool check_size = true) {
+    MappedFile map;
+    if (!map.open(filename)) {
+        std::cerr << "Error: no se pudo abrir " << filename << std::endl;
+        return false;
+    }
+    return pnm_parse_header(map.data(), map.size(), h, check_size);
+}
+
+
+// Decodifica el raster (ASCII o binario) que sigue a la cabecera.
+template <typename T>
+bool pnm_read_pixels(const unsigned char* file_data, size_t file_size, const PNMHeader& h, T* pixels) {
+    int pixel_count = h.width * h.height * h.channels;
+    const unsigned char* data = file_data + h.data_offset;
+    const unsigned char* end = file_data + file_size;
+
+    if (h.binary) {
+        size_t payload = (size_t) pixel_count * pnm_sample_bytes(h.max_color);
+        if ((size_t) (end - data) < payload) {
+            std::cerr << "Error leyendo píxeles: archivo truncado" << std::endl;
+            return false;
+        }
+        pnm_decode_binary(data, pixels, pixel_count, h.max_color);
+        return true;
+    }
+
+    int parsed = pnm_parse_ascii(data, end, pixels, pixel_count, h.max_color);
+    if (parsed != pixel_count) {
+        std::cerr << "Error leyendo píxeles (muestra " << parsed << " de "
+                  << pixel_count << ")" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
+template <typename T>
+bool load_pnm(const char* filename, char magic[3], int &width, int &height,
+              int &max_color, T* &pixels, int &pixel_count,
+              PNMReadStats* stats = nullptr) {
+    ProfileScope scope(STAGE_PARSE);
+    auto t0 = std::chrono::steady_clock::now();
+
+    MappedFile map;
+    if (!map.open(filename)) {
+        std::cerr << "Error: no se pudo abrir " << filename << std::endl;
+        return false;
+    }
+
+    PNMHeader h;
+    if (!pnm_parse_header(map.data(), map.size(), h)) return false;
+    if (h.max_color > (int) (T) ~0u) {
+        std::cerr << "Error: max_color " << h.max_color << " no cabe en " << sizeof(T) * 8 << " bits" << std::endl;
+        return false;
+    }
+
+    strcpy(magic, h.magic);
+    width = h.width;
+    height = h.height;
+    max_color = h.max_color;
+    pixel_count = width * height * h.channels;
+
+    scope.pause();
+    {
+        ProfileScope alloc(STAGE_ALLOCATE, (double) pixel_count * sizeof(T));
+        pixels = (T*) malloc((size_t) pixel_count * sizeof(T));
+    }
+    scope.resume();
+    if (!pixels) {
+        std::cerr << "Error reservando memoria" << std::endl;
+        return false;
+    }
+
+    if (!h.binary) madvise((void*) map.data(), map.size(), MADV_WILLNEED);
+    if (!pnm_read_pixels(map.data(), map.size(), h, pixels)) {
+        free(pixels);
+        pixels = nullptr;
+        return false;
+    }
+
+    scope.addBytes(map.size());
+    if (stats) {
+        stats->bytes = map.size();
+        stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        stats->ascii = !h.binary;
+    }
+    return true;
+}
+
+
+// Escritor con buffer propio: los enteros se formatean en memoria y se
+// vuelcan con pocas llamadas grandes a write().
+//
+// Escribe en un temporal del mismo directorio y close() lo renombra sobre
+// el destino. Asi la salida puede ser la propia entrada: PNMImage::load
+// deja las muestras de 8 bits en el mapeo del archivo, y truncarlo antes
+// de leerlas daba SIGBUS o un archivo cortado.
+class PNMWriter {
+private:
+    int fd;
+    char* buf;
+    size_t capacity;
+    size_t len;
+    bool ok;
+    size_t written;       // bytes ya entregados a write/writev
+    std::string target;
+    std::string temp;
+
+    PNMWriter(const PNMWriter&) = delete;
+    PNMWriter& operator=(const PNMWriter&) = delete;
+
+    bool writeAll(const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t n = ::write(fd, data, size);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            data += n;
+            size -= n;
+            written += n;
+        }
+        return true;
+    }
+
+public:
+    explicit PNMWriter(size_t capacity_bytes = 1 << 20)
+        : fd(-1), buf((char*) malloc(capacity_bytes)), capacity(capacity_bytes), len(0), ok(buf != nullptr),
+          written(0) {}
+
+    ~PNMWriter() {
+        close();
+        free(buf);
+    }
+
+    bool open(const char* filename) {
+        target = filename;
+        temp = target + ".tmpXXXXXX";
+        fd = mkstemp(&temp[0]);
+        if (fd < 0) return false;
+        fchmod(fd, 0644);
+        return ok;
+    }
+
+    bool flush() {
+        if (len > 0 && ok) ok = writeAll(buf, len);
+        len = 0;
+        return ok;
+    }
+
+    // Con error el temporal se borra y el destino queda como estaba.
+    bool close() {
+        if (fd < 0) return ok;
+        flush();
+        if (::close(fd) != 0) ok = false;
+        fd = -1;
+        if (ok && rename(temp.c_str(), target.c_str()) != 0) ok = false;
+        if (!ok) unlink(temp.c_str());
+        return ok;
+    }
+
+    // Abandona la salida: borra el temporal sin tocar el destino.
+    void discard() {
+        if (fd < 0) return;
+        ::close(fd);
+        fd = -1;
+        unlink(temp.c_str());
+    }
+
+    void put(const char* data, size_t size) {
+        if (len + size > capacity) flush();
+        if (size > capacity) {
+            if (ok) ok = writeAll(data, size);
+            return;
+        }
+        memcpy(buf + len, data, size);
+        len += size;
+    }
+
+    // Vuelca lo pendiente y escribe el bloque en una sola llamada (writev).
+    void putBlock(const void* data, size_t size) {
+        if (!ok) return;
+        const char* block = (const char*) data;
+        size_t head = len;
+        struct iovec iov[2] = {{buf, head}, {(void*) block, size}};
+        ssize_t n;
+        do {
+            n = ::writev(fd, iov, 2);
+        } while (n < 0 && errno == EINTR);
+        len = 0;
+        if (n < 0) {
+            ok = false;
+            return;
+        }
+        written += n;
+        if ((size_t) n < head) {
+            ok = writeAll(buf + n, head - n) && writeAll(block, size);
+        } else if ((size_t) n < head + size) {
+            ok = writeAll(block + (n - head), size - (n - head));
+        }
+    }
+
+    // Escribe "valor" seguido de 'sep'. Valores de 0 a 65535.
+    void putUInt(unsigned value, char sep) {
+        static const char digits[] =
+            "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+            "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+            "8081828384858687888990919293949596979899";
+        if (len + 8 > capacity) flush();
+
+        char tmp[8];
+        char* end = tmp + sizeof(tmp);
+        char* p = end;
+        while (value >= 100) {
+            unsigned r = value % 100;
+            value /= 100;
+            p -= 2;
+            memcpy(p, digits + 2 * r, 2);
+        }
+        if (value >= 10) {
+            p -= 2;
+            memcpy(p, digits + 2 * value, 2);
+        } else {
+            *--p = (char) ('0' + value);
+        }
+        size_t n = end - p;
+        memcpy(buf + len, p, n);
+        buf[len + n] = sep;
+        len += n + 1;
+    }
+
+    void putChar(char c) {
+        if (len + 1 > capacity) flush();
+        buf[len++] = c;
+    }
+
+    bool good() const { return ok; }
+    size_t bytesWritten() const { return written; }
+};
+
+
+template <typename T>
+bool save_pnm(const char* filename, const char magic[3], int width, int height,
+              int max_color, const T* pixels, int pixel_count) {
+    ProfileScope scope(STAGE_WRITE);
+    PNMWriter out;
+    if (!out.open(filename)) {
+        std::cerr << "Error: no se pudo abrir " << filename << " para escritura" << std::endl;
+        return false;
+    }
+
+    char header[64];
+    int header_len = snprintf(header, sizeof(header), "%s\n%d %d\n%d\n", magic, width, height, max_color);
+    out.put(header, header_len);
+
+    if (pnm_is_binary(magic)) {
+        int bytes = pnm_sample_bytes(max_color);
+        if (bytes == 1 && sizeof(T) == 1) {
+            // Las muestras ya estan en el formato del archivo.
+            out.putBlock(pixels, pixel_count);
+        } else {
+            unsigned char* payload = (unsigned char*) malloc((size_t) pixel_count * bytes);
+            if (!payload) {
+                std::cerr << "Error reservando memoria" << std::endl;
+                return false;
+            }
+            if (bytes == 1) {
+                for (int i = 0; i < pixel_count; i++) payload[i] = (unsigned char) pixels[i];
+            } else {
+                for (int i = 0; i < pixel_count; i++) {
+                    payload[2*i] = (unsigned char) (pixels[i] >> 8);
+                    payload[2*i + 1] = (unsigned char) (pixels[i] & 0xff);
+                }
+            }
+            out.putBlock(payload, (size_t) pixel_count * bytes);
+            free(payload);
+        }
+    } else {
+        // Mismo formato de siempre: valor + espacio, salto de linea cada 12.
+        int i = 0;
+        for (; i + 12 <= pixel_count; i += 12) {
+            for (int j = 0; j < 12; j++) out.putUInt((unsigned) pixels[i + j], ' ');
+            out.putChar('\n');
+        }
+        for (; i < pixel_count; i++) out.putUInt((unsigned) pixels[i], ' ');
+    }
+
+    bool closed = out.close();
+    scope.addBytes(out.bytesWritten());
+    if (!closed) {
+        std::cerr << "Error escribiendo " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
+// Hilo escritor opcional: save() encola una copia de la imagen y el calculo
+// sigue mientras el hilo formatea y escribe en disco.
+class PNMAsyncWriter {
+private:
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<std::function<bool()>> queue;
+    std::thread worker;
+    bool closing;
+    int failures;
+
+    PNMAsyncWriter(const PNMAsyncWriter&) = delete;
+    PNMAsyncWriter& operator=(const PNMAsyncWriter&) = delete;
+
+    void run() {
+        for (;;) {
+            std::function<bool()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [this] { return closing || !queue.empty(); });
+                if (queue.empty()) return;
+                job = std::move(queue.front());
+                queue.pop_front();
+            }
+            if (!job()) {
+                std::lock_guard<std::mutex> lock(mutex);
+                failures++;
+            }
+        }
+    }
+
+public:
+    PNMAsyncWriter() : closing(false), failures(0) {
+        worker = std::thread(&PNMAsyncWriter::run, this);
+    }
+
+    ~PNMAsyncWriter() { finish(); }
+
+    template <typename T>
+    void submit(const char* filename, const char magic[3], int width, int height,
+                int max_color, const T* pixels, int pixel_count) {
+        std::string name = filename;
+        std::string format = magic;
+        std::shared_ptr<std::vector<T>> copy = std::make_shared<std::vector<T>>(pixels, pixels + pixel_count);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back([=]() {
+                return save_pnm(name.c_str(), format.c_str(), width, height, max_color,
+                                copy->data(), pixel_count);
+            });
+        }
+        cond.notify_one();
+    }
+
+    // Espera a que se escriba todo lo encolado; false si alguna escritura fallo.
+    bool finish() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closing = true;
+        }
+        cond.notify_one();
+        if (worker.joinable()) worker.join();
+        return failures == 0;
+    }
+};
+
+#endif
@@ -0,0 +1,290 @@
+#ifndef PNM_STREAM_H
+#define PNM_STREAM_H
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "pnm_io.h"
+#include "convolve.h"
+
+// Lectura y escritura PNM fila a fila (--stream). La memoria no depende del
+// alto de la imagen: un buffer de lectura de 1 MB, el de escritura de
+// PNMWriter y la ventana de filas del filtro.
+
+
+// Lee las muestras de un PNM (ASCII o binario) por filas, con read() sobre
+// un buffer propio. La cabecera se interpreta con pnm_peek_header (solo
+// toca las primeras paginas del archivo) y puede pasar de 2^31 muestras.
+class PNMRowReader {
+private:
+    int fd;
+    unsigned char* buf;
+    size_t capacity, pos, len;
+    PNMHeader h;
+    size_t consumed;
+
+    PNMRowReader(const PNMRowReader&) = delete;
+    PNMRowReader& operator=(const PNMRowReader&) = delete;
+
+    // Mueve lo pendiente al principio y lee mas. false si no llego nada.
+    bool fill() {
+        if (pos > 0) {
+            memmove(buf, buf + pos, len - pos);
+            len -= pos;
+            pos = 0;
+        }
+        while (len < capacity) {
+            ssize_t n = ::read(fd, buf + len, capacity - len);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            len += n;
+            consumed += n;
+            if (len - pos >= capacity / 2) break;
+        }
+        return len > pos;
+    }
+
+    bool readBytes(unsigned char* dst, size_t size) {
+        while (size > 0) {
+            if (pos == len && !fill()) return false;
+            size_t n = std::min(size, len - pos);
+            memcpy(dst, buf + pos, n);
+            pos += n;
+            dst += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    // Siguiente muestra ASCII, con las mismas reglas que pnm_parse_ascii.
+    bool nextAscii(unsigned& value) {
+        const unsigned char* cls = pnm_char_class().cls;
+        for (;;) {
+            if (pos == len && !fill()) return false;
+            if (cls[buf[pos]] != 1) break;
+            pos++;
+        }
+        if (len - pos < 8) fill();   // el numero entero y su separador
+        if (cls[buf[pos]] != 0) return false;
+
+        size_t start = pos;
+        value = 0;
+        unsigned digit;
+        while (pos < len && (digit = (unsigned) (buf[pos] - '0')) <= 9) {
+            value = value * 10 + digit;
+            pos++;
+        }
+        return pos - start <= 5 && (int) value <= h.max_color;
+    }
+
+public:
+    PNMRowReader() : fd(-1), buf(nullptr), capacity(1 << 20), pos(0), len(0), h(), consumed(0) {}
+
+    ~PNMRowReader() {
+        if (fd >= 0) ::close(fd);
+        free(buf);
+    }
+
+    bool open(const char* filename) {
+        if (!pnm_peek_header(filename, h, false)) return false;
+        fd = ::open(filename, O_RDONLY);
+        buf = (unsigned char*) malloc(capacity);
+        if (fd < 0 || !buf || lseek(fd, (off_t) h.data_offset, SEEK_SET) < 0) {
+            std::cerr << "Error: no se pudo abrir " << filename << std::endl;
+            return false;
+        }
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        consumed = h.data_offset;
+        return true;
+    }
+
+    const PNMHeader& header() const { return h; }
+    size_t bytesRead() const { return consumed; }
+
+    template <typename T>
+    bool readRows(T* dst, int rows) {
+        size_t count = (size_t) rows * h.width * h.channels;
+        if (h.binary) {
+            size_t bytes = count * pnm_sample_bytes(h.max_color);
+            // Con 16 bits los bytes big-endian se leen en el destino y se
+            // decodifican en sitio.
+            if (!readBytes((unsigned char*) dst, bytes)) return false;
+            if (sizeof(T) > 1) pnm_decode_binary((const unsigned char*) dst, dst, (int) count, h.max_color);
+            return true;
+        }
+        for (size_t i = 0; i < count; i++) {
+            unsigned value;
+            if (!nextAscii(value)) return false;
+            dst[i] = (T) value;
+        }
+        return true;
+    }
+};
+
+
+// Escribe un PNM por filas con el mismo formato que save_pnm (en ASCII, un
+// salto de linea cada 12 valores contando desde el principio del raster).
+class PNMRowWriter {
+private:
+    PNMWriter out;
+    PNMHeader h;
+    size_t samples;
+    unsigned char* payload;
+    size_t payload_size;
+
+    PNMRowWriter(const PNMRowWriter&) = delete;
+    PNMRowWriter& operator=(const PNMRowWriter&) = delete;
+
+public:
+    PNMRowWriter() : samples(0), payload(nullptr), payload_size(0) {}
+    ~PNMRowWriter() { free(payload); }
+
+    bool open(const char* filename, const PNMHeader& header) {
+        h = header;
+        if (!out.open(filename)) {
+            std::cerr << "Error: no se pudo abrir " << filename << " para escritura" << std::endl;
+            return false;
+        }
+        char text[64];
+        int text_len = snprintf(text, sizeof(text), "%s\n%d %d\n%d\n", h.magic, h.width, h.height, h.max_color);
+        out.put(text, text_len);
+        return true;
+    }
+
+    template <typename T>
+    bool writeRows(const T* src, int rows) {
+        size_t count = (size_t) rows * h.width * h.channels;
+        if (h.binary) {
+            int bytes = pnm_sample_bytes(h.max_color);
+            if (bytes == 1 && sizeof(T) == 1) {
+                out.put((const char*) src, count);
+                return out.good();
+            }
+            if (payload_size < count * bytes) {
+                free(payload);
+                payload_size = count * bytes;
+                payload = (unsigned char*) malloc(payload_size);
+                if (!payload) {
+                    std::cerr << "Error reservando memoria" << std::endl;
+                    return false;
+                }
+            }
+            for (size_t i = 0; i < count; i++) {
+                if (bytes == 1) {
+                    payload[i] = (unsigned char) src[i];
+                } else {
+                    payload[2*i] = (unsigned char) (src[i] >> 8);
+                    payload[2*i + 1] = (unsigned char) (src[i] & 0xff);
+                }
+            }
+            out.put((const char*) payload, count * bytes);
+            return out.good();
+        }
+        for (size_t i = 0; i < count; i++) {
+            out.putUInt((unsigned) src[i], ' ');
+            if (++samples % 12 == 0) out.putChar('\n');
+        }
+        return out.good();
+    }
+
+    bool close() { return out.close(); }
+    void discard() { out.discard(); }
+    size_t bytesWritten() const { return out.bytesWritten(); }
+};
+
+
+// Filtra input -> output leyendo y escribiendo por filas. La ventana guarda
+// las filas [lo, hi) de la entrada en memoria contigua y run() la indexa por
+// fila absoluta (base = ventana - lo * pitch): para escribir un bloque de
+// filas [y0, y1) hacen falta [y0 - r, y1 + r). Tras cada bloque la ventana
+// se corre y solo se conservan las 2r filas que comparte con el siguiente.
+// Los bloques son multiplos de rowAlignment (FFT). --border wrap necesita
+// las ultimas filas para filtrar las primeras, asi que no se admite.
+template <typename T>
+bool filter_stream(const char* input, const char* output, const Kernel& kernel, const ConvOptions& conv) {
+    auto start = std::chrono::steady_clock::now();
+    PNMRowReader reader;
+    if (!reader.open(input)) return false;
+    const PNMHeader& h = reader.header();
+    if (conv.border == BORDER_WRAP) {
+        std::cerr << "Error: --stream no admite --border wrap" << std::endl;
+        return false;
+    }
+
+    const int width = h.width, height = h.height, r = kernel.radius();
+    const size_t pitch = (size_t) width * h.channels;
+    ConvPlan<T> plan(kernel, width, height, h.channels, h.max_color, conv);
+    const int align = plan.rowAlignment();
+    const int block = (std::max(64, align) + align - 1) / align * align;
+    const int window_rows = block + 2 * r;
+
+    T* window;
+    T* out;
+    {
+        ProfileScope scope(STAGE_ALLOCATE, (double) (window_rows + block) * pitch * sizeof(T));
+        window = (T*) malloc((size_t) window_rows * pitch * sizeof(T));
+        out = (T*) malloc((size_t) block * pitch * sizeof(T));
+    }
+    PNMRowWriter writer;
+    bool ok = window && out && writer.open(output, h);
+    if (!window || !out) std::cerr << "Error reservando memoria" << std::endl;
+
+    int lo = 0, hi = 0;
+    for (int y0 = 0; ok && y0 < height; y0 += block) {
+        int y1 = std::min(height, y0 + block);
+
+        // Corre la ventana hasta [y0 - r, y1 + r).
+        int keep_from = std::max(lo, y0 - r);
+        if (keep_from > lo) {
+            memmove(window, window + (size_t) (keep_from - lo) * pitch, (size_t) (hi - keep_from) * pitch * sizeof(T));
+            lo = keep_from;
+        }
+        int need = std::min(height, y1 + r);
+        if (need > hi) {
+            ProfileScope scope(STAGE_PARSE);
+            size_t before = reader.bytesRead();
+            bool read_ok = reader.readRows(window + (size_t) (hi - lo) * pitch, need - hi);
+            scope.addBytes(reader.bytesRead() - before);
+            if (!read_ok) {
+                std::cerr << "Error leyendo píxeles (fila " << hi << " de " << height << ")" << std::endl;
+                ok = false;
+                break;
+            }
+            hi = need;
+        }
+
+        {
+            ProfileScope scope(STAGE_FILTER, 2.0 * (y1 - y0) * pitch * sizeof(T));
+            plan.run(window - (ptrdiff_t) lo * (ptrdiff_t) pitch, 0, width, y0, y1, out, pitch);
+        }
+        ProfileScope scope(STAGE_WRITE);
+        size_t before = writer.bytesWritten();
+        ok = writer.writeRows(out, y1 - y0);
+        scope.addBytes(writer.bytesWritten() - before);
+    }
+    if (ok) {
+        ProfileScope scope(STAGE_WRITE);
+        size_t before = writer.bytesWritten();
+        if (!writer.close()) ok = false;
+        scope.addBytes(writer.bytesWritten() - before);
+    } else {
+        // Una lectura fallida no deja una salida a medias.
+        writer.discard();
+    }
+    if (!ok) std::cerr << "Error escribiendo " << output << std::endl;
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (ok) {
+        std::cout << "Streaming: " << height << " filas en " << seconds << " s ("
+                  << reader.bytesRead() / 1e6 / seconds << " MB/s leidos), ventana de " << window_rows
+                  << " filas (" << (window_rows + block) * pitch * sizeof(T) / 1024 << " KB)" << std::endl;
+    }
+    free(window);
+    free(out);
+    return ok;
+}
+
+#endif
@@ -0,0 +1,201 @@
+#ifdef PNMFILTER_WITH_MPI
+#include <mpi.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "pnmfilter.h"
+#include "row_strips.h"
+#include "thread_pool.h"
+#include "tile_filter.h"
+
+using namespace std;
+
+// Se compila dos veces: pnmfilter (sin MPI) y pnmfilter_mpi, con
+// PNMFILTER_WITH_MPI, que enlaza mpi_filterer.
+
+template class PNMImage<uint8_t>;
+template class PNMImage<uint16_t>;
+template class ConvPlan<uint8_t>;
+template class ConvPlan<uint16_t>;
+
+
+static const struct { const char* name; FilterBackend backend; } backends[] = {
+    {"serial", BACKEND_SERIAL}, {"openmp", BACKEND_OPENMP}, {"threads", BACKEND_THREADS}, {"mpi", BACKEND_MPI}
+};
+
+bool parse_backend(const char* name, FilterBackend& backend) {
+    for (const auto& b : backends) {
+        if (strcmp(name, b.name) == 0) {
+            backend = b.backend;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* backend_name(FilterBackend backend) {
+    for (const auto& b : backends) {
+        if (b.backend == backend) return b.name;
+    }
+    return "?";
+}
+
+bool backend_available(FilterBackend backend) {
+    switch (backend) {
+        case BACKEND_SERIAL:
+        case BACKEND_THREADS: return true;
+#ifdef _OPENMP
+        case BACKEND_OPENMP: return true;
+#endif
+#ifdef PNMFILTER_WITH_MPI
+        case BACKEND_MPI: {
+            int initialized = 0;
+            MPI_Initialized(&initialized);
+            return initialized != 0;
+        }
+#endif
+        default: return false;
+    }
+}
+
+
+template <typename T>
+void run_rows(const ConvPlan<T>& plan, const T* src, int width, int y0, int y1, T* dst, size_t pitch, int threads) {
+    if (y0 >= y1) return;
+    if (threads <= 1) {
+        plan.run(src, 0, width, y0, y1, dst, pitch);
+        return;
+    }
+    const int align = plan.rowAlignment();
+    int rows = ((y1 - y0 + 4 * threads - 1) / (4 * threads) + align - 1) / align * align;
+    int tiles = (y1 - y0 + rows - 1) / rows;
+    #pragma omp parallel for schedule(dynamic) num_threads(threads)
+    for (int tile = 0; tile < tiles; tile++) {
+        profile_thread();
+        int ty0 = y0 + tile * rows, ty1 = min(y1, ty0 + rows);
+        plan.run(src, 0, width, ty0, ty1, dst + (size_t) (ty0 - y0) * pitch, pitch);
+    }
+}
+
+
+static int default_threads(FilterBackend backend, int threads) {
+    if (threads > 0) return threads;
+#ifdef _OPENMP
+    if (backend != BACKEND_THREADS) return omp_get_max_threads();
+#endif
+    return max(1, (int) thread::hardware_concurrency());
+}
+
+// Pool persistente del hilo que llama, como el equipo de OpenMP: se crea en
+// la primera llamada y solo se recrea si cambia el numero de hilos.
+static ThreadPool& caller_pool(int threads) {
+    static thread_local unique_ptr<ThreadPool> pool;
+    if (!pool || pool->size() != threads) pool.reset(new ThreadPool(threads));
+    return *pool;
+}
+
+// Fuera de sitio con el pool: un bloque de filas por tarea.
+template <typename T>
+static void run_pool(const ConvPlan<T>& plan, const T* src, T* dst, int width, int height, int channels,
+                     int threads) {
+    ThreadPool& pool = caller_pool(threads);
+    const size_t pitch = (size_t) width * channels;
+    const int rows = tile_rows_for(plan, width, height, channels, plan.radius(), pool.size());
+    TaskGroup group(pool);
+    for (int y0 = 0; y0 < height; y0 += rows) {
+        int y1 = min(height, y0 + rows);
+        group.run([&, y0, y1]() { plan.run(src, 0, width, y0, y1, dst + (size_t) y0 * pitch, pitch); });
+    }
+    group.wait();
+}
+
+#ifdef PNMFILTER_WITH_MPI
+// Cada rango filtra su banda (con OpenMP dentro) y Allgatherv deja la
+// imagen completa en todos.
+template <typename T>
+static bool run_mpi(const ConvPlan<T>& plan, const T* src, T* dst, int width, int height, int channels,
+                    int threads) {
+    int rank, world;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &world);
+    const size_t pitch = (size_t) width * channels;
+    RowStrips strips(height, world, plan.radius(), plan.rowAlignment());
+
+    vector<int> counts(world), displs(world);
+    for (int r = 0; r < world; r++) {
+        counts[r] = (int) (strips.rows[r] * pitch);
+        displs[r] = (int) (strips.first[r] * pitch);
+    }
+    const int y0 = strips.first[rank];
+    run_rows(plan, src, width, y0, y0 + strips.rows[rank], dst + (size_t) y0 * pitch, pitch, threads);
+
+    MPI_Datatype type = (sizeof(T) == 1) ? MPI_UNSIGNED_CHAR : MPI_UNSIGNED_SHORT;
+    return MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, dst, counts.data(), displs.data(), type,
+                          MPI_COMM_WORLD) == MPI_SUCCESS;
+}
+#endif
+
+
+template <typename T>
+bool filter_pixels(const ConvPlan<T>& plan, const T* src, T* dst, int width, int height, int channels,
+                   FilterBackend backend, int threads) {
+    if (!backend_available(backend)) {
+        cerr << "Error: el backend " << backend_name(backend) << " no esta disponible en este programa" << endl;
+        return false;
+    }
+    const size_t pitch = (size_t) width * channels;
+    threads = default_threads(backend, threads);
+    ProfileScope scope(STAGE_FILTER, 2.0 * pitch * height * sizeof(T));
+    switch (backend) {
+        case BACKEND_OPENMP: run_rows(plan, src, width, 0, height, dst, pitch, threads); return true;
+        case BACKEND_THREADS: run_pool(plan, src, dst, width, height, channels, threads); return true;
+#ifdef PNMFILTER_WITH_MPI
+        case BACKEND_MPI: return run_mpi(plan, src, dst, width, height, channels, threads);
+#endif
+        default: plan.run(src, 0, width, 0, height, dst, pitch); return true;
+    }
+}
+
+
+template <typename T>
+bool filter_image(PNMImage<T>& img, const ConvPlan<T>& plan, FilterBackend backend, int threads) {
+    if (backend == BACKEND_THREADS) {
+        ThreadPool& pool = caller_pool(default_threads(backend, threads));
+        return filter_in_place(pool, plan, img.getPixels(), img.getWidth(), img.getHeight(), img.getChannels(),
+                               plan.radius(), plan.border());
+    }
+
+    T* result;
+    {
+        ProfileScope scope(STAGE_ALLOCATE, (double) img.getPixelCount() * sizeof(T));
+        result = (T*) malloc((size_t) img.getPixelCount() * sizeof(T));
+    }
+    if (!result) {
+        cerr << "Error reservando memoria para el filtro" << endl;
+        return false;
+    }
+    if (!filter_pixels(plan, img.getPixels(), result, img.getWidth(), img.getHeight(), img.getChannels(),
+                       backend, threads)) {
+        free(result);
+        return false;
+    }
+    img.setPixels(result);
+    return true;
+}
+
+
+#define PNMFILTER_INSTANTIATE(T) \
+    template void run_rows<T>(const ConvPlan<T>&, const T*, int, int, int, T*, size_t, int); \
+    template bool filter_pixels<T>(const ConvPlan<T>&, const T*, T*, int, int, int, FilterBackend, int); \
+    template bool filter_image<T>(PNMImage<T>&, const ConvPlan<T>&, FilterBackend, int);
+
+PNMFILTER_INSTANTIATE(uint8_t)
+PNMFILTER_INSTANTIATE(uint16_t)
@@ -0,0 +1,66 @@
+#ifndef PNMFILTER_H
+#define PNMFILTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include "pnm_image.h"
+#include "convolve.h"
+
+// libpnmfilter: API publica que comparten todos los programas.
+//
+//   PNMImage<T>   contenedor y codec (pnm_image.h, pnm_io.h)
+//   ConvPlan<T>   motor de convolucion (convolve.h)
+//   filter_image  ejecuta un plan sobre una imagen con el backend elegido
+//
+// Las plantillas se instancian una sola vez en la biblioteca
+// (src/pnmfilter.cpp) para uint8_t y uint16_t. Ejemplo:
+//
+//   PNMImage<uint8_t> img;
+//   img.load("entrada.pgm");
+//   Kernel kernel;
+//   filter_kernel("gaussian", 2, kernel);
+//   ConvPlan<uint8_t> plan(kernel, img.getWidth(), img.getHeight(),
+//                          img.getChannels(), img.getMaxColor(), ConvOptions());
+//   filter_image(img, plan, BACKEND_OPENMP, 0);
+//   img.save("salida.pgm");
+
+enum FilterBackend {
+    BACKEND_SERIAL,     // un hilo, ConvPlan::run sobre toda la imagen
+    BACKEND_OPENMP,     // bloques de filas con omp parallel for
+    BACKEND_THREADS,    // ThreadPool con robo de trabajo (en sitio)
+    BACKEND_MPI         // bandas por rango y MPI_Allgatherv; la imagen
+                        // debe estar en todos los rangos
+};
+
+bool parse_backend(const char* name, FilterBackend& backend);
+const char* backend_name(FilterBackend backend);
+
+// false si el backend no se compilo en este programa (OpenMP sin -fopenmp,
+// MPI fuera de pnmfilter_mpi) o si MPI no esta inicializado.
+bool backend_available(FilterBackend backend);
+
+// Filtra las filas [y0, y1) con threads hilos de OpenMP: bloques de filas
+// (multiplos de rowAlignment, al menos 4 por hilo) repartidos con
+// schedule(dynamic). y0 debe estar alineado y dst apunta a la fila y0.
+template <typename T>
+void run_rows(const ConvPlan<T>& plan, const T* src, int width, int y0, int y1, T* dst, size_t pitch, int threads);
+
+// src -> dst, los dos de width x height x channels muestras. threads <= 0:
+// uno por nucleo (con MPI, por rango). Avisa por cerr si el backend no esta
+// disponible.
+template <typename T>
+bool filter_pixels(const ConvPlan<T>& plan, const T* src, T* dst, int width, int height, int channels,
+                   FilterBackend backend, int threads);
+
+// Reemplaza las muestras de img por el resultado. BACKEND_THREADS filtra en
+// sitio; el resto usa un buffer nuevo.
+template <typename T>
+bool filter_image(PNMImage<T>& img, const ConvPlan<T>& plan, FilterBackend backend, int threads);
+
+
+extern template class PNMImage<uint8_t>;
+extern template class PNMImage<uint16_t>;
+extern template class ConvPlan<uint8_t>;
+extern template class ConvPlan<uint16_t>;
+
+#endif
@@ -0,0 +1,354 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// --profile: tiempo por etapa (lectura, reserva, filtrado, escritura y, en
+// MPI, comunicacion) con ProfileScope alrededor de cada etapa. Sin
+// --profile un ProfileScope solo lee un atomic.
+//
+// Si perf_event_open lo permite, cada etapa suma tambien ciclos,
+// instrucciones y fallos de la ultima cache. Cada hilo abre sus propios
+// contadores la primera vez que llama a profile_thread() (ProfileScope, los
+// hilos del ThreadPool, los bucles OpenMP de filtrado, los lectores y
+// escritores) y una etapa suma la diferencia de todos los hilos
+// registrados, sin depender de lo que inherit atribuye al hilo principal.
+// Un hilo que se registra a mitad de etapa cuenta desde ese momento. Como
+// la suma es de todo el proceso, las etapas solo se reparten bien si no se
+// solapan; en el modo lote corren a la vez y se suman igual que los tiempos.
+
+enum ProfileStage { STAGE_PARSE, STAGE_ALLOCATE, STAGE_FILTER, STAGE_WRITE, STAGE_COMM, STAGE_COUNT };
+enum ProfileCounter { COUNTER_CYCLES, COUNTER_INSTRUCTIONS, COUNTER_LLC_MISSES, COUNTER_COUNT };
+
+inline const char* stage_key(int stage) {
+    static const char* keys[STAGE_COUNT] = { "parse", "allocate", "filter", "write", "comm" };
+    return keys[stage];
+}
+
+inline const char* stage_label(int stage) {
+    static const char* labels[STAGE_COUNT] = { "lectura", "reserva", "filtrado", "escritura", "comunicacion" };
+    return labels[stage];
+}
+
+inline const char* counter_key(int counter) {
+    static const char* keys[COUNTER_COUNT] = { "cycles", "instructions", "llc_misses" };
+    return keys[counter];
+}
+
+// Solo doubles, para juntar los perfiles de todos los rangos con
+// MPI_Gather (MPI_DOUBLE, PROFILE_DOUBLES).
+struct StageTotals {
+    double calls, seconds, bytes;
+    double counters[COUNTER_COUNT];
+};
+
+struct ProfileSnapshot {
+    double elapsed;          // desde enable()
+    double counters_ok;      // 1 si hay contadores hardware
+    StageTotals stages[STAGE_COUNT];
+};
+
+const int PROFILE_DOUBLES = sizeof(ProfileSnapshot) / sizeof(double);
+
+
+class Profiler {
+private:
+    std::atomic<bool> on;
+    mutable std::mutex mutex;
+    std::vector<int> fds;     // COUNTER_COUNT por hilo registrado
+    bool counters_ok;
+    std::string counter_error;
+    StageTotals stages[STAGE_COUNT];
+    std::chrono::steady_clock::time_point start;
+
+    static int open_counter(unsigned long long config) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+
+    // Contadores del hilo que llama (pid 0, cpu -1); false si alguno falla.
+    static bool open_thread(int out[COUNTER_COUNT]) {
+        static const unsigned long long configs[COUNTER_COUNT] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES
+        };
+        for (int c = 0; c < COUNTER_COUNT; c++) {
+            out[c] = open_counter(configs[c]);
+            if (out[c] < 0) {
+                int err = errno;
+                for (int k = 0; k < c; k++) close(out[k]);
+                errno = err;
+                return false;
+            }
+        }
+        return true;
+    }
+
+public:
+    // Si el hilo ya tiene contadores (el de enable() los abre alli).
+    static bool& threadRegistered() {
+        static thread_local bool registered = false;
+        return registered;
+    }
+
+    Profiler() : on(false), counters_ok(false) {
+        memset(stages, 0, sizeof(stages));
+    }
+
+    ~Profiler() {
+        for (int fd : fds) close(fd);
+    }
+
+    // Antes de crear los hilos del pool, que se registran al arrancar.
+    void enable() {
+        if (on.load()) return;
+        int own[COUNTER_COUNT];
+        counters_ok = open_thread(own);
+        threadRegistered() = true;
+        if (counters_ok) fds.assign(own, own + COUNTER_COUNT);
+        else counter_error = strerror(errno);
+        start = std::chrono::steady_clock::now();
+        on.store(true);
+    }
+
+    // Contadores de un hilo mas. Los descriptores siguen abiertos cuando el
+    // hilo termina y conservan su cuenta final.
+    void registerThread() {
+        if (!counters_ok) return;
+        int own[COUNTER_COUNT];
+        if (!open_thread(own)) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        fds.insert(fds.end(), own, own + COUNTER_COUNT);
+    }
+
+    bool enabled() const { return on.load(std::memory_order_relaxed); }
+    bool countersAvailable() const { return counters_ok; }
+    const std::string& counterError() const { return counter_error; }
+
+    // Suma de todos los hilos registrados.
+    void readCounters(double values[COUNTER_COUNT]) const {
+        for (int c = 0; c < COUNTER_COUNT; c++) values[c] = 0.0;
+        if (!counters_ok) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < fds.size(); i++) {
+            unsigned long long value = 0;
+            if (read(fds[i], &value, sizeof(value)) == (ssize_t) sizeof(value)) {
+                values[i % COUNTER_COUNT] += (double) value;
+            }
+        }
+    }
+
+    void add(ProfileStage stage, double seconds, double bytes, const double counters[COUNTER_COUNT]) {
+        std::lock_guard<std::mutex> lock(mutex);
+        StageTotals& s = stages[stage];
+        s.calls++;
+        s.seconds += seconds;
+        s.bytes += bytes;
+        for (int c = 0; c < COUNTER_COUNT; c++) s.counters[c] += counters[c];
+    }
+
+    ProfileSnapshot snapshot() {
+        std::lock_guard<std::mutex> lock(mutex);
+        ProfileSnapshot snap;
+        snap.elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        snap.counters_ok = counters_ok ? 1.0 : 0.0;
+        memcpy(snap.stages, stages, sizeof(stages));
+        return snap;
+    }
+};
+
+inline Profiler& profiler() {
+    static Profiler instance;
+    return instance;
+}
+
+// Registra los contadores del hilo que llama la primera vez con --profile.
+// Sin --profile solo lee un atomic, asi que puede ir dentro de los bucles.
+inline void profile_thread() {
+    bool& registered = Profiler::threadRegistered();
+    if (registered || !profiler().enabled()) return;
+    registered = true;
+    profiler().registerThread();
+}
+
+
+// Mide desde la construccion hasta la destruccion y lo suma a la etapa.
+// bytes: datos que mueve la etapa (leidos, escritos o filtrados).
+class ProfileScope {
+private:
+    ProfileStage stage;
+    double bytes;
+    bool active;
+    bool running;
+    std::chrono::steady_clock::time_point t0;
+    double c0[COUNTER_COUNT];
+    double seconds;                  // tramos ya cerrados por pause()
+    double counted[COUNTER_COUNT];
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+public:
+    explicit ProfileScope(ProfileStage stage_, double bytes_ = 0.0)
+        : stage(stage_), bytes(bytes_), active(profiler().enabled()), running(false), seconds(0.0) {
+        if (!active) return;
+        profile_thread();
+        for (double& c : counted) c = 0.0;
+        resume();
+    }
+
+    ~ProfileScope() { stop(); }
+
+    // Deja fuera de la etapa lo que va entre pause() y resume(), por
+    // ejemplo una reserva que se mide en su propia etapa.
+    void pause() {
+        if (!active || !running) return;
+        running = false;
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        double c1[COUNTER_COUNT];
+        profiler().readCounters(c1);
+        for (int c = 0; c < COUNTER_COUNT; c++) counted[c] += c1[c] - c0[c];
+    }
+
+    void resume() {
+        if (!active || running) return;
+        running = true;
+        profiler().readCounters(c0);
+        t0 = std::chrono::steady_clock::now();
+    }
+
+    // Cierra la etapa antes del final del bloque.
+    void stop() {
+        if (!active) return;
+        pause();
+        active = false;
+        profiler().add(stage, seconds, bytes, counted);
+    }
+
+    void addBytes(double n) { bytes += n; }
+};
+
+
+// Tabla por etapa. Con varios rangos: tiempo minimo / medio / maximo entre
+// rangos y el resto sumado.
+inline void profile_report(std::ostream& out, const std::vector<ProfileSnapshot>& ranks) {
+    const size_t n = ranks.size();
+    bool counters = true;
+    double elapsed = 0.0;
+    for (const ProfileSnapshot& r : ranks) {
+        counters = counters && r.counters_ok != 0.0;
+        elapsed = std::max(elapsed, r.elapsed);
+    }
+
+    char line[256];
+    out << "=== Perfil por etapa";
+    if (n > 1) out << " (" << n << " rangos; tiempo min / medio / max)";
+    out << " ===\n";
+    snprintf(line, sizeof(line), "%-13s %8s %26s %10s %9s", "etapa", "llamadas", "tiempo (s)", "MB", "MB/s");
+    out << line;
+    if (counters) {
+        snprintf(line, sizeof(line), " %14s %14s %6s %12s", "ciclos", "instrucciones", "IPC", "fallos LLC");
+        out << line;
+    }
+    out << "\n";
+
+    double accounted = 0.0;
+    for (int s = 0; s < STAGE_COUNT; s++) {
+        StageTotals sum;
+        memset(&sum, 0, sizeof(sum));
+        double lo = 0.0, hi = 0.0;
+        for (size_t r = 0; r < n; r++) {
+            const StageTotals& t = ranks[r].stages[s];
+            sum.calls += t.calls;
+            sum.seconds += t.seconds;
+            sum.bytes += t.bytes;
+            for (int c = 0; c < COUNTER_COUNT; c++) sum.counters[c] += t.counters[c];
+            lo = (r == 0) ? t.seconds : std::min(lo, t.seconds);
+            hi = (r == 0) ? t.seconds : std::max(hi, t.seconds);
+        }
+        if (sum.calls == 0) continue;
+        double mean = sum.seconds / n;
+        accounted += mean;
+
+        char times[64];
+        if (n > 1) snprintf(times, sizeof(times), "%.4f / %.4f / %.4f", lo, mean, hi);
+        else snprintf(times, sizeof(times), "%.6f", mean);
+        snprintf(line, sizeof(line), "%-13s %8.0f %26s %10.2f %9.1f", stage_label(s), sum.calls, times,
+                 sum.bytes / 1e6, (hi > 0) ? sum.bytes / 1e6 / (n > 1 ? hi : mean) : 0.0);
+        out << line;
+        if (counters) {
+            double cycles = sum.counters[COUNTER_CYCLES], instructions = sum.counters[COUNTER_INSTRUCTIONS];
+            snprintf(line, sizeof(line), " %14.0f %14.0f %6.2f %12.0f", cycles, instructions,
+                     cycles > 0 ? instructions / cycles : 0.0, sum.counters[COUNTER_LLC_MISSES]);
+            out << line;
+        }
+        out << "\n";
+    }
+    snprintf(line, sizeof(line), "%-13s %8s %26.6f\n", "total", "", elapsed);
+    out << line;
+    snprintf(line, sizeof(line), "%-13s %8s %26.6f\n", "otros", "", std::max(0.0, elapsed - accounted));
+    out << line;
+    if (!counters) {
+        out << "Contadores hardware no disponibles";
+        if (!profiler().counterError().empty()) out << " (perf_event_open: " << profiler().counterError() << ")";
+        out << "\n";
+    }
+    out.flush();
+}
+
+// Resumen legible por maquina: un objeto por rango con sus etapas.
+inline bool profile_write_json(const char* filename, const char* program, const std::vector<ProfileSnapshot>& ranks) {
+    FILE* f = fopen(filename, "w");
+    if (!f) {
+        std::cerr << "Error: no se pudo abrir " << filename << " para escritura" << std::endl;
+        return false;
+    }
+    fprintf(f, "{\n  \"program\": \"%s\",\n  \"ranks\": [\n", program);
+    for (size_t r = 0; r < ranks.size(); r++) {
+        const ProfileSnapshot& snap = ranks[r];
+        fprintf(f, "    {\"rank\": %zu, \"elapsed_s\": %.9f, \"counters\": %s, \"stages\": {", r, snap.elapsed,
+                snap.counters_ok != 0.0 ? "true" : "false");
+        bool first = true;
+        for (int s = 0; s < STAGE_COUNT; s++) {
+            const StageTotals& t = snap.stages[s];
+            if (t.calls == 0) continue;
+            fprintf(f, "%s\n      \"%s\": {\"calls\": %.0f, \"seconds\": %.9f, \"bytes\": %.0f", first ? "" : ",",
+                    stage_key(s), t.calls, t.seconds, t.bytes);
+            if (snap.counters_ok != 0.0) {
+                for (int c = 0; c < COUNTER_COUNT; c++) fprintf(f, ", \"%s\": %.0f", counter_key(c), t.counters[c]);
+            }
+            fprintf(f, "}");
+            first = false;
+        }
+        fprintf(f, "\n    }}%s\n", (r + 1 < ranks.size()) ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    return fclose(f) == 0;
+}
+
+// Informe de un proceso: tabla por cout y, con json, el fichero.
+inline void profile_finish(const char* program, const char* json) {
+    if (!profiler().enabled()) return;
+    std::vector<ProfileSnapshot> ranks(1, profiler().snapshot());
+    profile_report(std::cout, ranks);
+    if (json) profile_write_json(json, program, ranks);
+}
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef ROW_STRIPS_H
+#define ROW_STRIPS_H
+
+#include <algorithm>
+#include <vector>
+
+// Reparto en bandas de filas contiguas. Cada banda tiene al menos r filas,
+// asi el halo de una banda sale entero de sus dos vecinas; si la imagen no
+// da para todos los rangos, los ultimos se quedan sin filas. Los cortes caen
+// en multiplos de align (rowAlignment del plan: con FFT un bloque lee todo
+// su bloque de la rejilla). La ultima banda puede acabar en un bloque
+// incompleto; si se queda con menos de r filas se une a la anterior.
+struct RowStrips {
+    int active;
+    std::vector<int> first, rows;
+
+    RowStrips(int height, int world, int radius, int align) : first(world, height), rows(world, 0) {
+        int units = (height + align - 1) / align;
+        int min_units = (std::max(radius, 1) + align - 1) / align;
+        active = std::max(1, std::min(world, units / min_units));
+        for (int r = 0, u = 0; r < active; r++) {
+            int take = units / active + (r < units % active ? 1 : 0);
+            first[r] = u * align;
+            rows[r] = std::min(height, (u + take) * align) - first[r];
+            u += take;
+        }
+        if (active > 1 && rows[active - 1] < std::max(radius, 1)) {
+            active--;
+            rows[active - 1] += rows[active];
+            first[active] = height;
+            rows[active] = 0;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,248 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "profile.h"
+
+// Pool de hilos persistente con robo de trabajo. Cada hilo tiene su propia
+// cola doble: las tareas que crea un hilo van al final de la suya y las
+// saca del final (LIFO, datos aun en cache); un hilo sin trabajo roba del
+// principio de la cola de otro (las tareas mas viejas, normalmente las mas
+// grandes). Asi una imagen puede repartir sus bloques entre todos los hilos
+// y un lote de imagenes pequenas no deja nucleos parados.
+
+class ThreadPool;
+
+// Conjunto de tareas que se espera junto. wait() ejecuta tareas pendientes
+// mientras espera, asi que una tarea puede crear un grupo y esperarlo sin
+// bloquear un hilo del pool.
+class TaskGroup {
+private:
+    ThreadPool& pool;
+    std::atomic<int> remaining;
+    std::mutex mutex;
+    std::condition_variable done;
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    // Bajo el mutex para que wait() no devuelva (y el grupo se destruya)
+    // mientras la ultima tarea aun lo usa.
+    void finished() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) done.notify_all();
+    }
+
+public:
+    explicit TaskGroup(ThreadPool& pool_) : pool(pool_), remaining(0) {}
+    ~TaskGroup() { wait(); }
+
+    inline void run(std::function<void()> task);
+    inline void wait();
+};
+
+
+class ThreadPool {
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+        std::thread thread;
+        long executed, stolen;     // estadisticas
+        double busy_time;
+
+        Worker() : executed(0), stolen(0), busy_time(0.0) {}
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+    std::atomic<int> queued;       // tareas encoladas aun sin tomar
+    std::atomic<unsigned> next_victim;
+    bool stopping;
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Indice del hilo actual en este pool, o -1 si es un hilo externo.
+    int currentIndex() const {
+        return (current_pool() == this) ? current_index() : -1;
+    }
+
+    static const ThreadPool*& current_pool() {
+        static thread_local const ThreadPool* pool = nullptr;
+        return pool;
+    }
+
+    static int& current_index() {
+        static thread_local int index = -1;
+        return index;
+    }
+
+    // Tareas anidadas (ejecutadas dentro de un TaskGroup::wait) no suman
+    // su tiempo dos veces.
+    static int& current_depth() {
+        static thread_local int depth = 0;
+        return depth;
+    }
+
+    // Saca una tarea: primero del final de la propia cola, luego robando
+    // del principio de las demas.
+    bool take(int self, std::function<void()>& task, bool& stolen) {
+        const int n = (int) workers.size();
+        {
+            Worker& w = *workers[self];
+            std::lock_guard<std::mutex> lock(w.mutex);
+            if (!w.tasks.empty()) {
+                task = std::move(w.tasks.back());
+                w.tasks.pop_back();
+                queued.fetch_sub(1, std::memory_order_relaxed);
+                stolen = false;
+                return true;
+            }
+        }
+        for (int k = 1; k < n; k++) {
+            int victim = (self + k) % n;
+            Worker& w = *workers[victim];
+            std::lock_guard<std::mutex> lock(w.mutex);
+            if (!w.tasks.empty()) {
+                task = std::move(w.tasks.front());
+                w.tasks.pop_front();
+                queued.fetch_sub(1, std::memory_order_relaxed);
+                stolen = true;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void execute(int self, std::function<void()>& task, bool stolen) {
+        Worker& w = *workers[self];
+        auto start = std::chrono::steady_clock::now();
+        current_depth()++;
+        task();
+        bool outer = (--current_depth() == 0);
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::lock_guard<std::mutex> lock(w.mutex);
+        if (outer) w.busy_time += elapsed;
+        w.executed++;
+        if (stolen) w.stolen++;
+    }
+
+    void loop(int self) {
+        profile_thread();
+        current_pool() = this;
+        current_index() = self;
+        for (;;) {
+            std::function<void()> task;
+            bool stolen;
+            if (take(self, task, stolen)) {
+                execute(self, task, stolen);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(wake_mutex);
+            wake.wait(lock, [this] { return stopping || queued.load(std::memory_order_relaxed) > 0; });
+            if (stopping && queued.load(std::memory_order_relaxed) == 0) return;
+        }
+    }
+
+public:
+    // threads <= 0: un hilo por nucleo.
+    explicit ThreadPool(int threads) : queued(0), next_victim(0), stopping(false) {
+        if (threads <= 0) threads = std::max(1, (int) std::thread::hardware_concurrency());
+        for (int i = 0; i < threads; i++) workers.push_back(std::unique_ptr<Worker>(new Worker()));
+        for (int i = 0; i < threads; i++) workers[i]->thread = std::thread(&ThreadPool::loop, this, i);
+    }
+
+    // Termina las tareas encoladas y detiene los hilos.
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& w : workers) w->thread.join();
+    }
+
+    int size() const { return (int) workers.size(); }
+
+    // Desde un hilo del pool la tarea va a su propia cola; desde fuera se
+    // reparten en turno rotatorio.
+    void submit(std::function<void()> task) {
+        int self = currentIndex();
+        int target = (self >= 0) ? self : (int) (next_victim.fetch_add(1, std::memory_order_relaxed) % workers.size());
+        {
+            std::lock_guard<std::mutex> lock(workers[target]->mutex);
+            workers[target]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            queued.fetch_add(1, std::memory_order_relaxed);
+        }
+        wake.notify_one();
+    }
+
+    // Ejecuta una tarea pendiente en el hilo actual, si es del pool y hay
+    // alguna. Un hilo externo solo espera, para no pasar de size() hilos.
+    bool runPending() {
+        int self = currentIndex();
+        if (self < 0) return false;
+        std::function<void()> task;
+        bool stolen;
+        if (!take(self, task, stolen)) return false;
+        execute(self, task, stolen);
+        return true;
+    }
+
+    // Tiempo ocupado sumado de todos los hilos.
+    double busyTime() const {
+        double total = 0.0;
+        for (const auto& w : workers) {
+            std::lock_guard<std::mutex> lock(w->mutex);
+            total += w->busy_time;
+        }
+        return total;
+    }
+
+    // Tareas, robos y tiempo ocupado por hilo.
+    void report(std::ostream& out) const {
+        for (size_t i = 0; i < workers.size(); i++) {
+            Worker& w = *workers[i];
+            std::lock_guard<std::mutex> lock(w.mutex);
+            out << "Hilo " << i << ": " << w.executed << " tareas (" << w.stolen
+                << " robadas), ocupado " << w.busy_time << " s" << std::endl;
+        }
+    }
+};
+
+
+inline void TaskGroup::run(std::function<void()> task) {
+    remaining.fetch_add(1, std::memory_order_relaxed);
+    pool.submit([this, task]() {
+        task();
+        finished();
+    });
+}
+
+inline void TaskGroup::wait() {
+    while (remaining.load(std::memory_order_acquire) > 0) {
+        if (pool.runPending()) continue;
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait_for(lock, std::chrono::milliseconds(1),
+                      [this] { return remaining.load(std::memory_order_acquire) == 0; });
+    }
+    std::lock_guard<std::mutex> lock(mutex);   // la ultima tarea ya solto el mutex
+}
+
+#endif
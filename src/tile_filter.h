@@ -0,0 +1,177 @@
+#ifndef TILE_FILTER_H
+#define TILE_FILTER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include "convolve.h"
+#include "thread_pool.h"
+#include "profile.h"
+
+// Filtrado en sitio sin carreras sobre el pool. La imagen se parte en
+// bloques de filas, una tarea por bloque. Cada bloque se filtra a un buffer
+// del hilo leyendo la imagen original; sus filas centrales se copian
+// enseguida (solo las lee el propio bloque), pero las r primeras y las r
+// ultimas (las "costuras") las leen tambien los bloques vecinos, asi que se
+// guardan aparte y se escriben cuando los dos bloques de esa frontera han
+// terminado de leer. La memoria extra es un bloque por hilo mas 2r filas
+// por bloque pendiente, y el resultado es el mismo que run() sobre toda la
+// imagen.
+template <typename T>
+class InPlaceTiles {
+private:
+    const ConvPlan<T>& plan;
+    T* pixels;
+    int width, height, radius;
+    size_t pitch;
+    int tiles, tile_rows;
+    bool wrap;                        // --border wrap: la primera y la ultima fila son vecinas
+    std::vector<std::atomic<int>> arrived;   // bloques que ya leyeron cada frontera
+    std::vector<T*> top_seam, bottom_seam;
+    std::atomic<bool> failed;         // algun bloque no pudo guardar sus costuras
+
+    void tileRows(int tile, int& y0, int& y1) const {
+        y0 = tile * tile_rows;
+        y1 = (tile == tiles - 1) ? height : y0 + tile_rows;
+    }
+
+    // Filas [y0, top) y [bottom, y1) del bloque son costuras.
+    void seamRows(int tile, int& top, int& bottom) const {
+        int y0, y1;
+        tileRows(tile, y0, y1);
+        top = std::min(y1, y0 + radius);
+        bottom = std::max(top, y1 - radius);
+    }
+
+    // La frontera b separa el bloque b - 1 del b. Sin wrap, la 0 y la
+    // ultima solo tocan un bloque y empiezan con una llegada.
+    int frontier(int tile, bool below) const {
+        int b = below ? tile + 1 : tile;
+        return wrap ? b % tiles : b;
+    }
+
+    // Escribe las costuras que tocan la frontera b.
+    void flush(int b) {
+        int above = (b > 0) ? b - 1 : (wrap ? tiles - 1 : -1);
+        int below = (b < tiles) ? b : -1;
+        int y0, y1, top, bottom;
+        if (above >= 0) {
+            tileRows(above, y0, y1);
+            seamRows(above, top, bottom);
+            if (bottom < y1 && bottom_seam[above]) {
+                memcpy(pixels + bottom * pitch, bottom_seam[above], (y1 - bottom) * pitch * sizeof(T));
+            }
+            free(bottom_seam[above]);
+            bottom_seam[above] = nullptr;
+        }
+        if (below >= 0) {
+            tileRows(below, y0, y1);
+            seamRows(below, top, bottom);
+            if (top > y0 && top_seam[below]) memcpy(pixels + y0 * pitch, top_seam[below], (top - y0) * pitch * sizeof(T));
+            free(top_seam[below]);
+            top_seam[below] = nullptr;
+        }
+    }
+
+    void arrive(int b) {
+        if (arrived[b].fetch_add(1, std::memory_order_acq_rel) == 1) flush(b);
+    }
+
+    // Buffer de salida del hilo actual, reutilizado entre bloques e imagenes.
+    static T* scratch(size_t samples) {
+        static thread_local std::vector<T> buffer;
+        if (buffer.size() < samples) buffer.resize(samples);
+        return buffer.data();
+    }
+
+public:
+    InPlaceTiles(const ConvPlan<T>& plan_, T* pixels_, int width_, int height_, int channels,
+                 int radius_, BorderMode border, int tile_rows_)
+        : plan(plan_), pixels(pixels_), width(width_), height(height_), radius(radius_),
+          pitch((size_t) width_ * channels), tiles(std::max(1, height_ / tile_rows_)),
+          tile_rows(tile_rows_), wrap(border == BORDER_WRAP), arrived(tiles + 1),
+          top_seam(tiles, nullptr), bottom_seam(tiles, nullptr), failed(false) {
+        for (int b = 0; b <= tiles; b++) arrived[b] = 0;
+        if (!wrap) {
+            arrived[0] = 1;
+            arrived[tiles] = 1;
+        }
+    }
+
+    int tileCount() const { return tiles; }
+    int tileHeight() const { return tile_rows; }
+    bool ok() const { return !failed.load(); }
+
+    void runTile(int tile) {
+        int y0, y1, top, bottom;
+        tileRows(tile, y0, y1);
+        seamRows(tile, top, bottom);
+        T* out = scratch((size_t) (y1 - y0) * pitch);
+        plan.run(pixels, 0, width, y0, y1, out, pitch);
+
+        if (bottom > top) memcpy(pixels + top * pitch, out + (top - y0) * pitch, (bottom - top) * pitch * sizeof(T));
+        size_t top_size = (top - y0) * pitch * sizeof(T), bottom_size = (y1 - bottom) * pitch * sizeof(T);
+        top_seam[tile] = (T*) malloc(std::max(top_size, (size_t) 1));
+        bottom_seam[tile] = (T*) malloc(std::max(bottom_size, (size_t) 1));
+        if (top_seam[tile] && bottom_seam[tile]) {
+            memcpy(top_seam[tile], out, top_size);
+            memcpy(bottom_seam[tile], out + (bottom - y0) * pitch, bottom_size);
+        } else {
+            // Sin costuras la imagen queda a medias; se sigue para que las
+            // fronteras se cierren y filter_in_place devuelve el error.
+            free(top_seam[tile]);
+            free(bottom_seam[tile]);
+            top_seam[tile] = bottom_seam[tile] = nullptr;
+            failed.store(true);
+        }
+
+        arrive(frontier(tile, false));
+        arrive(frontier(tile, true));
+    }
+};
+
+
+// Filas por bloque: las filas de entrada (con el halo del kernel) y las de
+// salida caben en ~256 KB de cache, y hay al menos 4 bloques por hilo para
+// repartir el final. Nunca menos de 2r filas, para que las dos costuras no
+// se solapen y un bloque solo comparta filas con sus dos vecinos.
+template <typename T>
+int tile_rows_for(const ConvPlan<T>& plan, int width, int height, int channels, int radius, int threads) {
+    const size_t cache_bytes = 256 * 1024;
+    size_t row_bytes = (size_t) width * channels * sizeof(T);
+    int rows = (int) (cache_bytes / (2 * row_bytes)) - 2 * radius;
+    rows = std::min(rows, (height + 4 * threads - 1) / (4 * threads));
+    rows = std::max(rows, std::max(2 * radius, 1));
+    int align = plan.rowAlignment();
+    return (rows + align - 1) / align * align;
+}
+
+
+// Filtra la imagen en sitio con los hilos de pool. Se puede llamar desde
+// una tarea del propio pool (por ejemplo, una imagen de un lote): mientras
+// espera, el hilo ejecuta bloques de esta u otras imagenes. Deja en tiles
+// el numero de bloques. false (y aviso por cerr) si falto memoria: la
+// imagen queda a medio filtrar y el que llama decide que hacer.
+template <typename T>
+bool filter_in_place(ThreadPool& pool, const ConvPlan<T>& plan, T* pixels, int width, int height,
+                     int channels, int radius, BorderMode border, int* tiles = nullptr) {
+    ProfileScope scope(STAGE_FILTER, 2.0 * width * height * channels * sizeof(T));
+    InPlaceTiles<T> work(plan, pixels, width, height, channels, radius, border,
+                         tile_rows_for(plan, width, height, channels, radius, pool.size()));
+    TaskGroup group(pool);
+    for (int tile = 0; tile < work.tileCount(); tile++) {
+        group.run([&work, tile]() { work.runTile(tile); });
+    }
+    group.wait();
+    if (tiles) *tiles = work.tileCount();
+    if (!work.ok()) {
+        std::cerr << "Error: no hay memoria para las costuras" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+#endif